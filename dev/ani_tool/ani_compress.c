@@ -0,0 +1,138 @@
+// Converts animations.img into the compressed animations.rle (see
+// src/ani_rle.h). Only valid animations are converted. Every frame record is
+// decoded again and compared to the original.
+//
+// usage: ./ani_compress animations.img [animations.rle]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "ani_file.h"
+#include "ani_rle.h"
+
+int main(int argc, char *args[]) {
+	if (argc < 2) {
+		printf("usage: %s animations.img [animations.rle]\n", args[0]);
+		return 1;
+	}
+	const char *f_name = argc > 2 ? args[2] : "animations.rle";
+
+	FILE *f_img = fopen(args[1], "rb");
+	struct stat st;
+	fileHeader_t fh;
+	if (f_img == NULL || stat(args[1], &st) != 0 ||
+		ani_read_file_header(f_img, &fh) != 0) {
+		printf("can't read %s\n", args[1]);
+		return 1;
+	}
+	FILE *f_out = fopen(f_name, "wb");
+	if (f_out == NULL) {
+		printf("can't write %s\n", f_name);
+		return 1;
+	}
+
+	ani_rle_header_t hdr = {
+		.magic = ANI_RLE_MAGIC, .version = ANI_RLE_VERSION
+	};
+	strncpy(hdr.buildStr, fh.buildStr, sizeof(hdr.buildStr) - 1);
+
+	ani_t *a = malloc(sizeof(ani_t));
+	ani_entry_t *entries = malloc(fh.nAnimations * sizeof(ani_entry_t));
+	uint8_t *stored = malloc(255 * ANI_FRAME_SIZE);
+	uint8_t out[ANI_FRAME_SIZE + ANI_RLE_REC_HDR];
+	uint8_t check[ANI_FRAME_SIZE];
+
+	long pos = sizeof(hdr) + fh.nAnimations * sizeof(ani_entry_t);
+	fseek(f_out, pos, SEEK_SET);
+
+	// bytes read from the SD card to play all animations once
+	long n_in = 0, n_out = 0;
+	int n = 0, n_types[4] = {0};
+	for (int i = 0; i < fh.nAnimations; i++) {
+		if (ani_read(f_img, i, a) != 0 ||
+			a->frameOffs + a->nStoredFrames * ani_frame_size(a) > st.st_size)
+			continue;
+
+		const int size = ani_frame_size(a);
+		fseek(f_img, a->frameOffs, SEEK_SET);
+		if (fread(stored, size, a->nStoredFrames, f_img) != a->nStoredFrames)
+			continue;
+
+		// the frame records follow the ani_t record
+		entries[n++] = (ani_entry_t){
+			.recOffs = pos,
+			.headerIndex = a->headerIndex,
+			.nStoredFrames = a->nStoredFrames,
+			.nFrameEntries = a->nFrameEntries,
+		};
+		long rec_pos = pos;
+		pos += ANI_REC_SIZE(a->nFrameEntries);
+		a->frameOffs = pos;
+		fseek(f_out, pos, SEEK_SET);
+
+		const uint8_t *prev = NULL;
+		int n_delta = 0;
+		for (int j = 0; j < a->nFrameEntries; j++) {
+			int frameId = a->frames[j].frameId;
+			int type = ANI_RLE_BLANK, len = 0;
+			const uint8_t *cur = NULL;
+			if (frameId > 0) {
+				cur = &stored[(frameId - 1) * size];
+				// forces a key frame
+				if (n_delta >= ANI_RLE_KEY_INTERVAL - 1)
+					prev = NULL;
+				len = ani_rle_encode(
+					a, cur, prev, &out[ANI_RLE_REC_HDR], &type
+				);
+				n_delta = type == ANI_RLE_DELTA ? n_delta + 1 : 0;
+				n_in += size;
+			}
+			out[0] = len;
+			out[1] = len >> 8;
+			out[2] = type;
+			fwrite(out, 1, ANI_RLE_REC_HDR + len, f_out);
+			pos += ANI_RLE_REC_HDR + len;
+			n_out += ANI_RLE_REC_HDR + len;
+			n_types[type]++;
+			a->frames[j].frameId = j + 1;
+
+			if (cur) {
+				if (prev)
+					memcpy(check, prev, size);
+				if (ani_rle_decode(
+						a, type, &out[ANI_RLE_REC_HDR], len, check
+					) || memcmp(check, cur, size) != 0) {
+					printf("%d: frame %d does not decode!\n", i, j);
+					return 1;
+				}
+				prev = cur;
+			}
+		}
+
+		fseek(f_out, rec_pos, SEEK_SET);
+		fwrite(a, 1, ANI_REC_SIZE(a->nFrameEntries), f_out);
+	}
+
+	hdr.n = n;
+	fseek(f_out, 0, SEEK_SET);
+	fwrite(&hdr, sizeof(hdr), 1, f_out);
+	fwrite(entries, sizeof(ani_entry_t), n, f_out);
+	fclose(f_out);
+	fclose(f_img);
+
+	printf(
+		"%d of %d animations, frames: %d raw, %d key, %d delta, %d blank\n",
+		n, fh.nAnimations, n_types[ANI_RLE_RAW], n_types[ANI_RLE_KEY],
+		n_types[ANI_RLE_DELTA], n_types[ANI_RLE_BLANK]
+	);
+	printf(
+		"file size: %ld -> %ld bytes, read per playback: %ld -> %ld bytes "
+		"(%.1f x)\n", (long)st.st_size, pos, n_in, n_out,
+		n_out ? (double)n_in / n_out : 0
+	);
+	printf("    wrote %s\n", f_name);
+	free(a);
+	free(entries);
+	free(stored);
+	return 0;
+}
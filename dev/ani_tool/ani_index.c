@@ -0,0 +1,43 @@
+// Builds the animation index (animations.idx) of an animations.img on the
+// host. Copy both files to the SD card, the clock then skips indexing at
+// boot.
+//
+// usage: ./ani_index animations.img [animations.idx]
+#include <stdio.h>
+#include <sys/stat.h>
+#include "ani_file.h"
+
+int main(int argc, char *args[]) {
+	if (argc < 2) {
+		printf("usage: %s animations.img [animations.idx]\n", args[0]);
+		return 1;
+	}
+	const char *f_name = argc > 2 ? args[2] : "animations.idx";
+
+	FILE *f_img = fopen(args[1], "rb");
+	struct stat st;
+	fileHeader_t fh;
+	if (f_img == NULL || stat(args[1], &st) != 0 ||
+		ani_read_file_header(f_img, &fh) != 0) {
+		printf("can't read %s\n", args[1]);
+		return 1;
+	}
+
+	// no modification time, it changes when copying to the SD card
+	ani_key_t key;
+	ani_make_key(&key, &fh, st.st_size, 0);
+
+	FILE *f_idx = fopen(f_name, "wb");
+	if (f_idx == NULL) {
+		printf("can't write %s\n", f_name);
+		return 1;
+	}
+	int n = ani_index_build(f_img, f_idx, &key);
+	fclose(f_idx);
+	fclose(f_img);
+	if (n < 0)
+		return 1;
+
+	printf("    wrote %s\n", f_name);
+	return 0;
+}
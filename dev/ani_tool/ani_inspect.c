@@ -0,0 +1,406 @@
+// Lists, validates, renders and benchmarks the animations of an
+// animations.img, with the same parsing and decoding code as the clock.
+//
+// usage: ./ani_inspect list animations.img
+//        ./ani_inspect validate animations.img
+//        ./ani_inspect render animations.img index out.gif|out [color]
+//                      [scale] [anchor]
+//        ./ani_inspect bench animations.img|animations.rle [rounds]
+//
+// `validate` prints the broken animations and exits with 1 if there are any.
+// `render` writes animation `index` (position in the header table) as an
+// animated .gif or as out_000.png, out_001.png, ... one per frame table
+// entry. `color` is 0xBBGGRR, like SRGBA(). Smaller animations are placed
+// like on the clock, see the `animations` settings.
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "ani_file.h"
+#include "ani_rle.h"
+#include "common.h"
+#include "frame_buffer.h"
+#include "png.h"
+
+#define SCALE 4
+#define OUT_W (DISPLAY_WIDTH * SCALE)
+#define OUT_H (DISPLAY_HEIGHT * SCALE)
+
+// a frame of the size of the display, 2 pixels per byte
+#define DISPLAY_FRAME_SIZE (DISPLAY_WIDTH * DISPLAY_HEIGHT / 2)
+
+static FILE *f_img;
+static struct stat st;
+static fileHeader_t fh;
+static ani_t a;
+
+static int64_t time_us() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+// Checks animation `i` like ani_read() and the index do. Returns why it is
+// not played or NULL.
+static const char *check(int i) {
+	static char reason[64];
+	headerEntry_t h;
+
+	memset(&a, 0, offsetof(ani_t, frames));
+	fseek(f_img, HEADER_OFFS + HEADER_SIZE * i, SEEK_SET);
+	if (fread(&h, sizeof(h), 1, f_img) != 1)
+		return "header table beyond end of file";
+	if (ani_read(f_img, i, &a) != 0) {
+		if (h.nFrameEntries == 0 || h.nStoredFrames == 0)
+			return "no frames";
+		for (int j = 0; j < a.nFrameEntries; j++) {
+			if (a.frames[j].frameDur == 0) {
+				sprintf(reason, "frame %d: duration 0", j);
+				return reason;
+			}
+			if (a.frames[j].frameId > a.nStoredFrames) {
+				sprintf(
+					reason, "frame %d: id %d > %d stored", j,
+					a.frames[j].frameId, a.nStoredFrames
+				);
+				return reason;
+			}
+		}
+		return "frame table beyond end of file";
+	}
+	if (a.frameOffs + a.nStoredFrames * ani_frame_size(&a) > st.st_size)
+		return "frames beyond end of file";
+	return NULL;
+}
+
+static int cmd_list() {
+	printf("index    id  stored  entries     size  ms  name\n");
+	for (int i = 0; i < fh.nAnimations; i++) {
+		const char *err = check(i);
+		int dur = 0;
+		for (int j = 0; !err && j < a.nFrameEntries; j++)
+			dur += a.frames[j].frameDur;
+		printf(
+			"%5d  %04x  %6d  %7d  %3dx%-3d  %5d  %s%s%s\n", i, a.animationId,
+			a.nStoredFrames, a.nFrameEntries, a.width, a.height, dur, a.name,
+			err ? "  INVALID: " : "", err ? err : ""
+		);
+	}
+	return 0;
+}
+
+static int cmd_validate() {
+	int n = 0;
+	for (int i = 0; i < fh.nAnimations; i++) {
+		const char *err = check(i);
+		if (err) {
+			printf("%5d  %s: %s\n", i, a.name, err);
+			n++;
+		}
+	}
+	printf("%d of %d animations are invalid\n", n, fh.nAnimations);
+	return n > 0;
+}
+
+// ----------------------
+//  .gif writer
+// ----------------------
+// Uncompressed LZW: only literal codes, with a clear code before the code
+// table would grow. 16 colors, the 4 bit pixels are the palette index.
+typedef struct {
+	FILE *f;
+	uint8_t blk[256]; // data sub-block being filled, blk[0] is its length
+	uint32_t bits;
+	int n_bits;
+} gif_t;
+
+static void gif_code(gif_t *g, unsigned code) {
+	g->bits |= code << g->n_bits;
+	g->n_bits += 5;
+	while (g->n_bits >= 8) {
+		g->blk[++g->blk[0]] = g->bits;
+		g->bits >>= 8;
+		g->n_bits -= 8;
+		if (g->blk[0] == 255) {
+			fwrite(g->blk, 1, 256, g->f);
+			g->blk[0] = 0;
+		}
+	}
+}
+
+static void gif_start(gif_t *g, const unsigned *shades) {
+	fwrite("GIF89a", 1, 6, g->f);
+	uint8_t lsd[] = {
+		OUT_W & 0xFF, OUT_W >> 8, OUT_H & 0xFF, OUT_H >> 8, 0xF3, 0, 0
+	};
+	fwrite(lsd, 1, sizeof(lsd), g->f);
+	for (int i = 0; i < N_SHADES; i++) {
+		// 0x0A is transparent, the clock shows the layers below
+		unsigned c = i == 0x0A ? 0 : shades[i];
+		uint8_t rgb[] = {GR(c), GG(c), GB(c)};
+		fwrite(rgb, 1, 3, g->f);
+	}
+	// loop forever
+	fwrite("\x21\xFF\x0BNETSCAPE2.0\x03\x01\x00\x00\x00", 1, 19, g->f);
+}
+
+static void gif_frame(gif_t *g, const uint8_t *frame, int dur_ms) {
+	int cs = (dur_ms + 5) / 10;
+	if (cs < 2) // faster is not shown by most viewers
+		cs = 2;
+	uint8_t gce[] = {0x21, 0xF9, 4, 0x04, cs, cs >> 8, 0, 0};
+	uint8_t desc[] = {0x2C, 0, 0, 0, 0, OUT_W & 0xFF, OUT_W >> 8, OUT_H & 0xFF,
+					  OUT_H >> 8, 0, 4};
+	fwrite(gce, 1, sizeof(gce), g->f);
+	fwrite(desc, 1, sizeof(desc), g->f);
+
+	g->blk[0] = 0;
+	g->bits = 0;
+	g->n_bits = 0;
+	int n = 0;
+	for (int y = 0; y < OUT_H; y++) {
+		for (int x = 0; x < OUT_W; x++) {
+			if (n++ % 14 == 0)
+				gif_code(g, 16); // clear
+			int p = (y / SCALE) * DISPLAY_WIDTH + x / SCALE;
+			gif_code(g, (frame[p / 2] >> (p & 1 ? 0 : 4)) & 0x0F);
+		}
+	}
+	gif_code(g, 17); // end of information
+	if (g->n_bits > 0)
+		gif_code(g, 0);
+	if (g->blk[0] > 0)
+		fwrite(g->blk, 1, g->blk[0] + 1, g->f);
+	fputc(0, g->f);
+}
+
+// ----------------------
+//  render
+// ----------------------
+// the 4 bit pixels of `frame` at their place on the display, for the .gif
+static void place_frame(
+	const uint8_t *frame, const frame_place_t *pl, uint8_t *dst
+) {
+	memset(dst, 0, DISPLAY_FRAME_SIZE);
+	for (int y = 0; y < pl->h * pl->scale; y++) {
+		for (int x = 0; x < pl->w * pl->scale; x++) {
+			int p = y / pl->scale * pl->w + x / pl->scale;
+			int v = (frame[p / 2] >> (p & 1 ? 0 : 4)) & 0x0F;
+			int q = (pl->y0 + y) * DISPLAY_WIDTH + pl->x0 + x;
+			dst[q / 2] |= v << (q & 1 ? 0 : 4);
+		}
+	}
+}
+
+static int cmd_render(
+	int i, const char *out, unsigned color, int scale, const char *anchor
+) {
+	static uint8_t frame[ANI_FRAME_SIZE], rgb[OUT_W * OUT_H * 3];
+	static uint8_t placed[DISPLAY_FRAME_SIZE];
+	char f_name[256];
+
+	if (i < 0 || i >= fh.nAnimations) {
+		printf("index must be < %d\n", fh.nAnimations);
+		return 1;
+	}
+	const char *err = check(i);
+	if (err) {
+		printf("%d is invalid: %s\n", i, err);
+		return 1;
+	}
+
+	frame_place_t pl;
+	set_frame_place(&pl, a.width, a.height, scale, anchor);
+
+	unsigned shades[N_SHADES];
+	set_shade_opaque(color, shades);
+	gif_t g = {0};
+	int len = strlen(out);
+	bool is_gif = len > 4 && strcmp(&out[len - 4], ".gif") == 0;
+	if (is_gif) {
+		if ((g.f = fopen(out, "wb")) == NULL) {
+			printf("can't write %s\n", out);
+			return 1;
+		}
+		gif_start(&g, shades);
+	}
+
+	for (int j = 0; j < a.nFrameEntries; j++) {
+		int frameId = a.frames[j].frameId;
+		if (frameId == 0) {
+			// invalid frames are shown as black
+			memset(frame, 0, sizeof(frame));
+		} else {
+			int size = ani_frame_size(&a);
+			fseek(f_img, ani_frame_pos(&a, frameId), SEEK_SET);
+			if (fread(frame, 1, size, f_img) != size)
+				return 1;
+		}
+
+		if (is_gif) {
+			place_frame(frame, &pl, placed);
+			gif_frame(&g, placed, a.frames[j].frameDur);
+			continue;
+		}
+
+		// through the decoder of the clock
+		setFromBufPlaced(frame, 2, color, &pl);
+		for (int p = 0; p < OUT_W * OUT_H; p++) {
+			int x = p % OUT_W / SCALE, y = p / OUT_W / SCALE;
+			unsigned c = g_frameBuff[2][y * DISPLAY_WIDTH + x];
+			rgb[p * 3 + 0] = GR(c);
+			rgb[p * 3 + 1] = GG(c);
+			rgb[p * 3 + 2] = GB(c);
+		}
+		snprintf(f_name, sizeof(f_name), "%s_%03d.png", out, j);
+		if (png_write(f_name, rgb, OUT_W, OUT_H))
+			return 1;
+	}
+
+	if (is_gif) {
+		fputc(0x3B, g.f);
+		fclose(g.f);
+	}
+	printf(
+		"%d, %s: %d frames, wrote %s%s\n", i, a.name, a.nFrameEntries, out,
+		is_gif ? "" : "_*.png"
+	);
+	return 0;
+}
+
+// ----------------------
+//  bench
+// ----------------------
+// Plays all valid animations without delays, like the reader task and the
+// player do. File reads come from the page cache of the host, the numbers
+// compare decoder changes, not SD card speed. They don't carry over to the
+// ESP32, which has other caches and no 64 bit stores.
+static int cmd_bench(const char *f_name, int rounds) {
+	static uint8_t frame[ANI_FRAME_SIZE], rec[ANI_FRAME_SIZE];
+	ani_index_t idx;
+	int64_t t_read = 0, t_decode = 0, t_fb = 0;
+	long n_frames = 0, n_bytes = 0;
+
+	char magic[4] = {0};
+	fread(magic, 1, 4, f_img);
+	bool is_rle = memcmp(magic, ANI_RLE_MAGIC, 4) == 0;
+	if (is_rle) {
+		if (ani_rle_open(&idx, f_img, &fh) != 0) {
+			printf("can't read %s\n", f_name);
+			return 1;
+		}
+	} else {
+		if (ani_read_file_header(f_img, &fh) != 0) {
+			printf("can't read %s\n", f_name);
+			return 1;
+		}
+		idx.n = fh.nAnimations;
+	}
+
+	for (int r = 0; r < rounds; r++) {
+		for (int i = 0; i < idx.n; i++) {
+			if (is_rle) {
+				if (ani_index_load(&idx, i, &a) != 0)
+					return 1;
+				fseek(f_img, a.frameOffs, SEEK_SET);
+			} else if (check(i)) {
+				continue;
+			}
+			frame_place_t pl;
+			set_frame_place(&pl, a.width, a.height, 0, "center");
+
+			for (int j = 0; j < a.nFrameEntries; j++) {
+				int frameId = a.frames[j].frameId;
+				int64_t t = time_us();
+				if (is_rle) {
+					uint8_t hdr[ANI_RLE_REC_HDR];
+					if (fread(hdr, 1, ANI_RLE_REC_HDR, f_img) != ANI_RLE_REC_HDR)
+						return 1;
+					int len = hdr[0] | hdr[1] << 8;
+					if (len > ANI_FRAME_SIZE || fread(rec, 1, len, f_img) != len)
+						return 1;
+					n_bytes += ANI_RLE_REC_HDR + len;
+					int64_t t1 = time_us();
+					t_read += t1 - t;
+					if (hdr[2] == ANI_RLE_BLANK)
+						continue;
+					if (ani_rle_decode(&a, hdr[2], rec, len, frame) != 0) {
+						printf("%d: frame %d does not decode\n", i, j);
+						return 1;
+					}
+					t = time_us();
+					t_decode += t - t1;
+				} else {
+					if (frameId == 0)
+						continue;
+					int size = ani_frame_size(&a);
+					fseek(f_img, ani_frame_pos(&a, frameId), SEEK_SET);
+					if (fread(frame, 1, size, f_img) != size)
+						return 1;
+					n_bytes += size;
+					int64_t t1 = time_us();
+					t_read += t1 - t;
+					t = t1;
+				}
+
+				setFromBufPlaced(frame, 2, 0xFF00A0FF, &pl);
+				t_fb += time_us() - t;
+				n_frames++;
+			}
+		}
+	}
+
+	if (n_frames == 0) {
+		printf("no valid frames\n");
+		return 1;
+	}
+	printf(
+		"%s, %ld frames, %ld bytes read\n"
+		"per frame: read %.2f us, decode %.2f us, setFromBuf %.2f us\n",
+		is_rle ? "animations.rle" : "animations.img", n_frames, n_bytes,
+		(double)t_read / n_frames, (double)t_decode / n_frames,
+		(double)t_fb / n_frames
+	);
+	return 0;
+}
+
+int main(int argc, char *args[]) {
+	if (argc < 3) {
+		printf(
+			"usage: %s list|validate animations.img\n"
+			"       %s render animations.img index out.gif|out [color]\n"
+			"       %s bench animations.img|animations.rle [rounds]\n",
+			args[0], args[0], args[0]
+		);
+		return 1;
+	}
+	const char *cmd = args[1];
+
+	f_img = fopen(args[2], "rb");
+	if (f_img == NULL || stat(args[2], &st) != 0) {
+		printf("can't read %s\n", args[2]);
+		return 1;
+	}
+	if (strcmp(cmd, "bench") == 0)
+		return cmd_bench(args[2], argc > 3 ? atoi(args[3]) : 10);
+
+	if (ani_read_file_header(f_img, &fh) != 0) {
+		printf("can't read %s\n", args[2]);
+		return 1;
+	}
+	if (strcmp(cmd, "list") == 0)
+		return cmd_list();
+	if (strcmp(cmd, "validate") == 0)
+		return cmd_validate();
+	if (strcmp(cmd, "render") == 0 && argc > 4)
+		return cmd_render(
+			atoi(args[3]), args[4],
+			argc > 5 ? strtoul(args[5], NULL, 0) | 0xFF000000 : 0xFF00A0FF,
+			argc > 6 ? atoi(args[6]) : 0, argc > 7 ? args[7] : "center"
+		);
+
+	printf("unknown command: %s\n", cmd);
+	return 1;
+}
@@ -0,0 +1,172 @@
+// Rewrites animations.img so that the frames of each animation are stored in
+// playback order. The clock then reads an animation front to back without
+// seeking. The frame table of each animation starts on a 512 byte sector and
+// the frames follow it back to back, so they stay sector aligned if the frame
+// size is a multiple of 512 bytes, like the 2048 bytes of a 128 x 32 frame.
+// Frames which are shown more than once are stored again, so the file grows.
+// Invalid animations are dropped.
+//
+// Prints the SD card access of playing all animations once, without the
+// frame cache, for both layouts.
+//
+// usage: ./ani_relayout animations.img [animations_seq.img]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "ani_file.h"
+
+#define ALIGN(x) (((x) + HEADER_SIZE - 1) / HEADER_SIZE * HEADER_SIZE)
+
+typedef struct {
+	long n_seeks; // reads which don't continue where the last one ended
+	long n_bytes; // bytes read
+} io_model_t;
+
+// Models playing `a` with the reader of src/ani_prefetch.c: one read of the
+// frame table, then one read per valid frame entry.
+static void model_playback(const ani_t *a, io_model_t *m) {
+	long cur_pos = -1;
+	m->n_seeks++;
+	m->n_bytes += HEADER_SIZE;
+	for (int i = 0; i < a->nFrameEntries; i++) {
+		int frameId = a->frames[i].frameId;
+		if (frameId == 0)
+			continue;
+		long pos = ani_frame_pos(a, frameId);
+		if (pos != cur_pos)
+			m->n_seeks++;
+		cur_pos = pos + ani_frame_size(a);
+		m->n_bytes += ani_frame_size(a);
+	}
+}
+
+int main(int argc, char *args[]) {
+	if (argc < 2) {
+		printf("usage: %s animations.img [animations_seq.img]\n", args[0]);
+		return 1;
+	}
+	const char *f_name = argc > 2 ? args[2] : "animations_seq.img";
+
+	FILE *f_img = fopen(args[1], "rb");
+	struct stat st;
+	fileHeader_t fh;
+	if (f_img == NULL || stat(args[1], &st) != 0 ||
+		ani_read_file_header(f_img, &fh) != 0) {
+		printf("can't read %s\n", args[1]);
+		return 1;
+	}
+	FILE *f_out = fopen(f_name, "wb");
+	if (f_out == NULL) {
+		printf("can't write %s\n", f_name);
+		return 1;
+	}
+
+	ani_t *a = malloc(sizeof(ani_t));
+	uint8_t *stored = malloc(255 * ANI_FRAME_SIZE);
+	uint8_t *head = malloc(HEADER_OFFS);
+	uint8_t ent[HEADER_SIZE];
+	uint8_t table[HEADER_SIZE];
+
+	// everything before the header table is kept as it is
+	fseek(f_img, 0, SEEK_SET);
+	if (fread(head, 1, HEADER_OFFS, f_img) != HEADER_OFFS) {
+		printf("can't read %s\n", args[1]);
+		return 1;
+	}
+
+	// the data of the animations follows the header table
+	long data_pos = ALIGN(HEADER_OFFS + (long)fh.nAnimations * HEADER_SIZE);
+	long pos = data_pos;
+
+	io_model_t before = {0}, after = {0};
+	int n = 0;
+	for (int i = 0; i < fh.nAnimations; i++) {
+		if (ani_read(f_img, i, a) != 0 ||
+			a->frameOffs + a->nStoredFrames * ani_frame_size(a) > st.st_size)
+			continue;
+
+		const int size = ani_frame_size(a);
+		fseek(f_img, a->frameOffs, SEEK_SET);
+		if (fread(stored, size, a->nStoredFrames, f_img) != a->nStoredFrames)
+			continue;
+
+		// without any valid frame, the clock would reject the copy
+		int nValid = 0;
+		for (int j = 0; j < a->nFrameEntries; j++)
+			nValid += a->frames[j].frameId > 0;
+		if (nValid == 0)
+			continue;
+		model_playback(a, &before);
+
+		// the header entry, with all unknown fields
+		fseek(f_img, HEADER_OFFS + HEADER_SIZE * i, SEEK_SET);
+		if (fread(ent, 1, HEADER_SIZE, f_img) != HEADER_SIZE)
+			continue;
+
+		// frame table, then the frames in playback order
+		memset(table, 0, sizeof(table));
+		fseek(f_out, pos + HEADER_SIZE, SEEK_SET);
+		int nStored = 0;
+		for (int j = 0; j < a->nFrameEntries; j++) {
+			int frameId = a->frames[j].frameId;
+			if (frameId > 0) {
+				fwrite(&stored[(frameId - 1) * size], 1, size, f_out);
+				a->frames[j].frameId = ++nStored;
+			}
+			table[j * 2] = a->frames[j].frameId;
+			table[j * 2 + 1] = a->frames[j].frameDur;
+		}
+		fseek(f_out, pos, SEEK_SET);
+		fwrite(table, 1, HEADER_SIZE, f_out);
+
+		headerEntry_t *h = (headerEntry_t *)ent;
+		uint32_t byteOffset = pos / HEADER_SIZE;
+		h->nStoredFrames = nStored;
+		h->byteOffset = SWAP32(byteOffset);
+		fseek(f_out, HEADER_OFFS + HEADER_SIZE * n, SEEK_SET);
+		fwrite(ent, 1, HEADER_SIZE, f_out);
+
+		a->nStoredFrames = nStored;
+		a->frameOffs = pos + HEADER_SIZE;
+		model_playback(a, &after);
+		if (!ani_is_sequential(a)) {
+			printf("%d: not sequential!\n", i);
+			return 1;
+		}
+		n++;
+
+		pos = ALIGN(a->frameOffs + (long)nStored * size);
+	}
+
+	// the header table shrinks to the valid animations, the gap stays empty
+	uint16_t nAnimations = SWAP16(n);
+	memcpy(&head[3], &nAnimations, 2);
+	fseek(f_out, 0, SEEK_SET);
+	fwrite(head, 1, HEADER_OFFS, f_out);
+	if (n < fh.nAnimations) {
+		memset(ent, 0, sizeof(ent));
+		fseek(f_out, HEADER_OFFS + HEADER_SIZE * n, SEEK_SET);
+		for (int i = n; i < fh.nAnimations; i++)
+			fwrite(ent, 1, HEADER_SIZE, f_out);
+	}
+	fseek(f_out, 0, SEEK_END);
+	long out_size = ftell(f_out);
+	fclose(f_out);
+	fclose(f_img);
+
+	printf("%d of %d animations\n", n, fh.nAnimations);
+	printf(
+		"file size: %ld -> %ld bytes\n"
+		"per playback of all animations:\n"
+		"  seeks: %ld -> %ld\n"
+		"  read:  %ld -> %ld bytes\n",
+		(long)st.st_size, out_size, before.n_seeks, after.n_seeks, before.n_bytes,
+		after.n_bytes
+	);
+	printf("    wrote %s\n", f_name);
+	free(a);
+	free(stored);
+	free(head);
+	return 0;
+}
@@ -0,0 +1,113 @@
+"""
+Generate the per channel intensity tables of the LED panel (calibration.bin).
+
+Copy the output file to the SD card. If it exists, it replaces the
+`calibration` section of settings.json. The tables are computed the same way
+as enc_calibrate() in src/panel_encoder.c:
+
+    v = curve(i / 255)
+    v = black + (1 - black) * v  (for i > 0)
+    lut[i] = v * gain * 65535
+
+curve is a power law with exponent `gamma`, or with `gamma` = 0 the built in
+gamma curve (lumConvTab in src/val2pwm.c), or linear with --no-gamma.
+
+File format: 3 x 256 little endian uint16, for R, G and B.
+"""
+import re
+import argparse
+from pathlib import Path
+from struct import pack
+
+VAL2PWM_C = Path(__file__).parent.parent / "src/val2pwm.c"
+
+
+def get_builtin_curve():
+    """ intensity curve of valToPwm16(), parsed from val2pwm.c """
+    src = VAL2PWM_C.read_text()
+    tab = re.search(r"lumConvTab\[\]\s*=\s*{([^}]*)}", src).group(1)
+    tab = [int(x) for x in re.findall(r"\d+", tab)]
+    if len(tab) != 256:
+        raise ValueError(f"lumConvTab has {len(tab)} entries")
+    return [(65535 - x) / 65535 for x in tab]
+
+
+def get_lut(gain, gamma, black, builtin):
+    lut = []
+    for i in range(256):
+        v = builtin[i]
+        if gamma > 0:
+            v = (i / 255) ** gamma
+        if i > 0:
+            v = black + (1 - black) * v
+        v = int(v * gain * 65535 + 0.5)
+        lut.append(min(max(v, 0), 65535))
+    return lut
+
+
+def rgb_arg(s):
+    """ 1 value for all channels or 3 comma separated values for R, G, B """
+    vals = [float(x) for x in s.split(",")]
+    if len(vals) == 1:
+        vals *= 3
+    if len(vals) != 3:
+        raise argparse.ArgumentTypeError("expected 1 or 3 values")
+    return vals
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description=__doc__, formatter_class=argparse.RawTextHelpFormatter
+    )
+    parser.add_argument(
+        "--gain",
+        default="1",
+        type=rgb_arg,
+        help="White balance, 0 .. 1. Example: --gain 1,0.8,0.9",
+    )
+    parser.add_argument(
+        "--gamma",
+        default="0",
+        type=rgb_arg,
+        help="Exponent of the intensity curve. 0 = built in gamma curve",
+    )
+    parser.add_argument(
+        "--black",
+        default="0",
+        type=rgb_arg,
+        help="Lowest intensity of non zero values, as fraction of full scale",
+    )
+    parser.add_argument(
+        "--no-gamma",
+        action="store_true",
+        help="Use a linear curve instead of the built in one (is_gamma = false)",
+    )
+    parser.add_argument(
+        "--print", action="store_true", help="Print the tables as text"
+    )
+    parser.add_argument(
+        "out_file", nargs="?", default="calibration.bin", help="Output file"
+    )
+    args = parser.parse_args()
+
+    builtin = get_builtin_curve()
+    if args.no_gamma:
+        builtin = [i / 255 for i in range(256)]
+
+    luts = [
+        get_lut(args.gain[ch], args.gamma[ch], args.black[ch], builtin)
+        for ch in range(3)
+    ]
+
+    if args.print:
+        for i in range(256):
+            print(f"{i:3d}: {luts[0][i]:5d} {luts[1][i]:5d} {luts[2][i]:5d}")
+
+    with open(args.out_file, "wb") as f:
+        for lut in luts:
+            f.write(pack("<256H", *lut))
+    print("    wrote", args.out_file)
+
+
+if __name__ == "__main__":
+    main()
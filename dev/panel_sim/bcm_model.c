@@ -0,0 +1,65 @@
+// Host model of the hybrid BCM schedule in src/bcm_schedule.c
+// Prints the resulting panel refresh rate and the effective brightness
+// weights of the bitplanes, no scope needed.
+//
+// usage: ./bcm_model [clkm_div_num] [brightness] [bcm_lsb_planes]
+#include <stdio.h>
+#include <stdlib.h>
+#include "bcm_schedule.h"
+#include "common.h"
+#include "panel_encoder.h"
+
+#define BITPLANE_SZ (DISPLAY_WIDTH * DISPLAY_HEIGHT / 2)
+
+static void print_model(int clk_div, int br, int n_lsb) {
+	bcm_schedule_t s;
+	bcm_schedule_init(&s, BITPLANE_CNT, n_lsb);
+
+	int total = 0;
+	for (int pl = 0; pl < s.n_planes; pl++)
+		total += bcm_weight(&s, pl, br);
+
+	// the hybrid schedule appends a dark row to each bitplane, see enc_rows()
+	int rows = DISPLAY_HEIGHT / 2, n_rows = rows + (n_lsb > 0);
+
+	printf(
+		"bcm_lsb_planes: %d, slots: %3d, refresh: %7.1f Hz, duty: %5.1f %%\n",
+		s.n_lsb, s.len,
+		bcm_refresh_rate(&s, clk_div, BITPLANE_SZ / rows * n_rows),
+		100.0 * total / s.len / DISPLAY_WIDTH * rows / n_rows
+	);
+
+	// weight of plane 0 if everything was perfectly binary
+	float unit = (float)total / ((1 << s.n_planes) - 1);
+	printf("  plane  reps  oe_width  weight   ideal  error\n");
+	for (int pl = 0; pl < s.n_planes; pl++) {
+		int w = bcm_weight(&s, pl, br);
+		float ideal = unit * (1 << pl);
+		printf(
+			"  %5d  %4d  %8d  %6d  %6.1f  %4.0f %%\n", pl, s.reps[pl],
+			bcm_oe_width(&s, pl, br), w, ideal, 100.0 * (w - ideal) / ideal
+		);
+	}
+
+	printf("  slots:");
+	for (int i = 0; i < s.len; i++)
+		printf(" %d", s.slots[i]);
+	printf("\n\n");
+}
+
+int main(int argc, char *args[]) {
+	int clk_div = argc > 1 ? atoi(args[1]) : 4;
+	int br = argc > 2 ? atoi(args[2]) : 20;
+
+	printf("clkm_div_num: %d, brightness: %d\n\n", clk_div, br);
+
+	if (argc > 3) {
+		print_model(clk_div, br, atoi(args[3]));
+		return 0;
+	}
+
+	for (int n_lsb = 0; n_lsb < BITPLANE_CNT; n_lsb++)
+		print_model(clk_div, br, n_lsb);
+
+	return 0;
+}
@@ -0,0 +1,635 @@
+// Host test and benchmark of the bitplane encoder in src/panel_encoder.c
+//
+// Compares the encoder against a copy of the original updateFrame() loop,
+// checks the OE windows, the golden hashes of the dithered / hybrid BCM
+// variants, the mean of the dithered output, the current estimate and the
+// pixel mapping of zigzag, serpentine, 64x64 and 2 x 2 64x32 layouts and
+// measures the time per frame.
+// encoder_test64 runs the same for a 64x64 framebuffer, without the golden
+// hashes.
+//
+// usage: ./encoder_test [-g]  (-g: print the golden hashes)
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "common.h"
+#include "frame_buffer.h"
+#include "panel_encoder.h"
+#include "val2pwm.h"
+#include "vpanel.h"
+
+#define BITPLANE_SZ (DISPLAY_WIDTH * DISPLAY_HEIGHT / 2)
+// with the appended row of the hybrid schedule
+#define BITPLANE_MAX (BITPLANE_SZ + DISPLAY_WIDTH)
+
+static panel_encoder_t enc;
+static layout_map_t map[BITPLANE_SZ];
+static uint16_t ref_planes[BITPLANE_CNT][BITPLANE_SZ];
+static int n_fail = 0;
+
+static void check(bool ok, const char *msg) {
+	if (!ok) {
+		printf("FAIL: %s\n", msg);
+		n_fail++;
+	}
+}
+
+// -------------------------------------------------------------------
+//  Reference: the encoder loop of updateFrame() before the refactoring
+// -------------------------------------------------------------------
+static unsigned ref_pixel(unsigned x, unsigned y, bool is_gamma) {
+	unsigned c = getBlendedPixelRawIdx(x + y * DISPLAY_WIDTH);
+	if (is_gamma)
+		c = (valToPwm(GB(c)) << 16) | (valToPwm(GG(c)) << 8) | valToPwm(GR(c));
+	return c;
+}
+
+static void ref_update(int br, bool is_gamma) {
+	int oe_start = (DISPLAY_WIDTH - br) / 2;
+	int oe_stop = (DISPLAY_WIDTH + br) / 2;
+
+	for (unsigned int y = 0; y < DISPLAY_HEIGHT / 2; y++) {
+		// the original code also set BIT_E on row 0, as y - 1 wrapped to -1.
+		// Unused on 1/16 scan panels, the encoder wraps to scan - 1 instead
+		unsigned y_prev = (y - 1) & (DISPLAY_HEIGHT / 2 - 1);
+		unsigned lbits = 0;
+
+		if (y_prev & 1)
+			lbits |= BIT_A;
+		if (y_prev & 2)
+			lbits |= BIT_B;
+		if (y_prev & 4)
+			lbits |= BIT_C;
+		if (y_prev & 8)
+			lbits |= BIT_D;
+		if (y_prev & 16)
+			lbits |= BIT_E;
+
+		for (int x = 0; x < DISPLAY_WIDTH; x++) {
+			int x_ = ESP32_TX_FIFO_POSITION_ADJUST(x);
+			unsigned v = lbits;
+
+			if (!(x_ >= oe_start && x_ < oe_stop))
+				v |= BIT_OE_N;
+
+			if (x_ == (DISPLAY_WIDTH - 1))
+				v |= BIT_LAT;
+
+			unsigned c1 = ref_pixel(x_, y, is_gamma);
+			unsigned c2 = ref_pixel(x_, y + DISPLAY_HEIGHT / 2, is_gamma);
+
+			for (int pl = 0; pl < BITPLANE_CNT; pl++) {
+				unsigned v_ = v;
+				unsigned mask = (1 << (8 - BITPLANE_CNT + pl));
+
+				if (c1 & (mask << 0))
+					v_ |= BIT_R1;
+				if (c1 & (mask << 8))
+					v_ |= BIT_G1;
+				if (c1 & (mask << 16))
+					v_ |= BIT_B1;
+				if (c2 & (mask << 0))
+					v_ |= BIT_R2;
+				if (c2 & (mask << 8))
+					v_ |= BIT_G2;
+				if (c2 & (mask << 16))
+					v_ |= BIT_B2;
+
+				ref_planes[pl][y * DISPLAY_WIDTH + x] = v_;
+			}
+		}
+	}
+}
+
+// -------------------
+//  Test frame content
+// -------------------
+static unsigned rnd_state = 1;
+
+static unsigned rnd() {
+	rnd_state = rnd_state * 1103515245 + 12345;
+	return rnd_state >> 8;
+}
+
+// premultiplied RGBA with random alpha
+static unsigned rnd_color() {
+	unsigned a = rnd() & 0xFF;
+	unsigned r = INT_MULT(rnd() & 0xFF, a, 0);
+	unsigned g = INT_MULT(rnd() & 0xFF, a, 0);
+	unsigned b = INT_MULT(rnd() & 0xFF, a, 0);
+	return SRGBA(r, g, b, a);
+}
+
+static void fill_frame(int n) {
+	rnd_state = n + 1;
+	for (int y = 0; y < DISPLAY_HEIGHT; y++) {
+		for (int x = 0; x < DISPLAY_WIDTH; x++) {
+			switch (n) {
+			case 0:  // gray ramp, all 256 levels
+				setPixel(0, x, y, 0xFF000000 | 0x010101 * ((x * 2 + y) & 0xFF));
+				setPixel(1, x, y, 0);
+				setPixel(2, x, y, 0);
+				break;
+
+			case 1:  // opaque noise
+				setPixel(0, x, y, 0xFF000000 | rnd());
+				setPixel(1, x, y, 0);
+				setPixel(2, x, y, 0);
+				break;
+
+			default:  // 3 blended layers
+				setPixel(0, x, y, 0xFF000000 | rnd());
+				setPixel(1, x, y, rnd_color());
+				setPixel(2, x, y, (x ^ y) & 4 ? rnd_color() : 0);
+				break;
+			}
+		}
+	}
+}
+
+#define N_FRAMES 3
+
+// ----------------------
+//  Encoder configuration
+// ----------------------
+static void enc_setup(bool is_gamma, int dither, int n_lsb) {
+	for (int pl = 0; pl < BITPLANE_CNT; pl++) {
+		memset(enc.bitplane[pl], 0, BITPLANE_MAX * 2);
+		enc.oe_start[pl] = enc.oe_stop[pl] = 0;
+	}
+	bcm_schedule_init(&enc.bcm, BITPLANE_CNT, n_lsb);
+	enc_init(&enc, is_gamma, dither);
+}
+
+static uint32_t fnv1a(uint32_t h, const void *buf, size_t n) {
+	const uint8_t *p = buf;
+	while (n--) {
+		h ^= *p++;
+		h *= 16777619;
+	}
+	return h;
+}
+
+static uint32_t hash_planes() {
+	uint32_t h = 2166136261;
+	for (int pl = 0; pl < BITPLANE_CNT; pl++)
+		h = fnv1a(h, enc.bitplane[pl], enc_bitplane_bytes(&enc));
+	return h;
+}
+
+// column of DMA word `x` of a row
+static int word_col(int x) {
+	return enc.is_8bit ? ESP32_TX_FIFO_POSITION_ADJUST8(x) :
+						 ESP32_TX_FIFO_POSITION_ADJUST(x);
+}
+
+// Every row of a bitplane must have exactly bcm_oe_width() columns enabled,
+// none of them in the oe_guard columns, except for the dark first row of the
+// hybrid schedule
+static void check_oe(int br) {
+	for (int pl = 0; pl < BITPLANE_CNT; pl++) {
+		for (int y = 0; y < enc_rows(&enc); y++) {
+			int w = bcm_oe_width(&enc.bcm, pl, br);
+			w = MIN(w, enc.layout.row_len - enc.oe_guard);
+			if (y == 0 && enc_rows(&enc) > enc.layout.scan)
+				w = 0;
+			int n = 0, n_guard = 0;
+			for (int x = 0; x < enc.layout.row_len; x++) {
+				int i = y * enc.layout.row_len + x;
+				if (enc.is_8bit ? !(enc.bitplane8[pl][i] & BIT8_OE_N) :
+								  !(enc.bitplane[pl][i] & BIT_OE_N)) {
+					n++;
+					if (word_col(x) < enc.oe_guard)
+						n_guard++;
+				}
+			}
+			// the row address may still change in the guard columns
+			if (n_guard > 0) {
+				printf("plane %d, row %d: %d columns on in the guard\n", pl, y, n_guard);
+				check(false, "OE window in the guard columns");
+				return;
+			}
+			if (n != w) {
+				printf("plane %d, row %d: %d columns on, %d expected\n", pl, y, n, w);
+				check(false, "OE window width");
+				return;
+			}
+		}
+	}
+}
+
+static const int brightness[] = {0, 2, 60, 126};
+#define N_BR (sizeof(brightness) / sizeof(brightness[0]))
+
+// bit exact against the original encoder, with and without gamma
+static void test_reference() {
+	for (int gamma = 0; gamma <= 1; gamma++) {
+		for (int n = 0; n < N_FRAMES; n++) {
+			fill_frame(n);
+			for (unsigned b = 0; b < N_BR; b++) {
+				enc_setup(gamma, 0, 0);
+				enc_set_brightness(&enc, brightness[b]);
+				enc_update(&enc, 0);
+				ref_update(brightness[b], gamma);
+
+				bool is_same = true;
+				for (int pl = 0; pl < BITPLANE_CNT; pl++)
+					if (memcmp(enc.bitplane[pl], ref_planes[pl], BITPLANE_SZ * 2))
+						is_same = false;
+				if (!is_same)
+					printf("frame %d, gamma %d, brightness %d\n", n, gamma, brightness[b]);
+				check(is_same, "encoder differs from reference");
+				check_oe(brightness[b]);
+			}
+		}
+	}
+}
+
+// patching the OE windows in place must give the same result as encoding
+// the frame from scratch
+static void test_patch_oe() {
+	fill_frame(2);
+	for (int mode = 0; mode < 6; mode++) {
+		// bcm_lsb_planes 0 / 3, 16 / 8 bit DMA words, 8 bit with a guard
+		int n_lsb = mode & 1 ? 3 : 0;
+		enc.is_8bit = mode & 6;
+		enc.oe_guard = mode & 4 ? 16 : 0;
+		for (unsigned b = 0; b < N_BR; b++) {
+			enc_setup(true, 0, n_lsb);
+			enc_set_brightness(&enc, brightness[b]);
+			enc_update(&enc, 0);
+			uint32_t h = hash_planes();
+
+			enc_setup(true, 0, n_lsb);
+			enc_set_brightness(&enc, 40);
+			enc_update(&enc, 0);
+			for (unsigned b_ = 0; b_ < N_BR; b_++)
+				enc_set_brightness(&enc, brightness[b_]);
+			enc_set_brightness(&enc, brightness[b]);
+
+			check(h == hash_planes(), "patched OE differs from full encode");
+			check_oe(brightness[b]);
+		}
+	}
+	enc.is_8bit = false;
+	enc.oe_guard = 0;
+}
+
+// (dither, bcm_lsb_planes, frame counter) variants covered by the hashes
+static const int variants[][3] = {
+	{1, 0, 0}, {2, 0, 5}, {0, 3, 0}, {2, 3, 11},
+};
+#define N_VARIANTS (sizeof(variants) / sizeof(variants[0]))
+
+// regenerate with `./encoder_test -g` after intentional changes
+static const uint32_t golden[N_VARIANTS][2][N_FRAMES] = {
+	{{0x846b7edd, 0xaae78ca6, 0x5757aeb3}, {0x92dccd89, 0xbbdc2c66, 0x69340186}},
+	{{0x80449c55, 0xb4ff873e, 0x6a8a1fd3}, {0xad296455, 0x13bdc5fb, 0xfa636d83}},
+	{{0x45b0a3fd, 0x832c0816, 0xf2094897}, {0x1c20d6e5, 0xb55faf8e, 0x634bd446}},
+	{{0xb80bdfa1, 0x1e7f864d, 0x6ae311f7}, {0xa40eb765, 0x5cb5bb8b, 0x8dbe034b}},
+};
+
+static void test_golden(bool is_print) {
+	// the hashes are those of the default 128 x 32 framebuffer
+	if (DISPLAY_WIDTH != 128 || DISPLAY_HEIGHT != 32)
+		return;
+	if (is_print)
+		printf("static const uint32_t golden[N_VARIANTS][2][N_FRAMES] = {\n");
+
+	for (unsigned v = 0; v < N_VARIANTS; v++) {
+		if (is_print)
+			printf("\t{");
+		for (int gamma = 0; gamma <= 1; gamma++) {
+			if (is_print)
+				printf("%s{", gamma ? ", " : "");
+			for (int n = 0; n < N_FRAMES; n++) {
+				fill_frame(n);
+				enc_setup(gamma, variants[v][0], variants[v][1]);
+				enc_set_brightness(&enc, 60);
+				enc_update(&enc, variants[v][2]);
+				uint32_t h = hash_planes();
+				if (is_print)
+					printf("%s0x%08x", n ? ", " : "", h);
+				else if (h != golden[v][gamma][n]) {
+					printf("variant %d, gamma %d, frame %d: 0x%08x\n", v, gamma, n, h);
+					check(false, "golden hash mismatch");
+				}
+			}
+			if (is_print)
+				printf("}");
+		}
+		if (is_print)
+			printf("},\n");
+	}
+
+	if (is_print)
+		printf("};\n");
+}
+
+// the image shown by the virtual panel must match the framebuffer within
+// the quantization to BITPLANE_CNT bits
+static void test_vpanel() {
+	static float lin[DISPLAY_WIDTH * DISPLAY_HEIGHT * 3];
+	static uint8_t rgb[DISPLAY_WIDTH * DISPLAY_HEIGHT * 3];
+
+	for (int mode = 0; mode < 4; mode++) {
+		// bcm_lsb_planes 0 / 3, 16 / 8 bit DMA words
+		int n_lsb = mode & 1 ? 3 : 0;
+		for (int n = 0; n < N_FRAMES; n++) {
+			fill_frame(n);
+			enc.is_8bit = mode & 2;
+			enc_setup(false, 0, n_lsb);
+			enc_set_brightness(&enc, enc.layout.row_len - 2);
+			enc_update(&enc, 0);
+			vpanel_run(&enc, lin);
+			vpanel_to_rgb8(&enc, lin, rgb);
+
+			int max_err = 0;
+			for (int i = 0; i < DISPLAY_WIDTH * DISPLAY_HEIGHT; i++) {
+				unsigned c = getBlendedPixelRawIdx(i);
+				for (int ch = 0; ch < 3; ch++) {
+					int err = abs((int)GC(c, ch) - rgb[i * 3 + ch]);
+					if (err > max_err)
+						max_err = err;
+				}
+			}
+			if (max_err > 1 << (8 - BITPLANE_CNT))
+				printf("mode %d, frame %d: error %d\n", mode, n, max_err);
+			check(max_err <= 1 << (8 - BITPLANE_CNT), "virtual panel image");
+		}
+	}
+	enc.is_8bit = false;
+}
+
+// encoded value of channel `ch` of pixel (x, y) of the upper half, in the
+// reference layout of ref_update()
+static int enc_value(int x, int y, int ch) {
+	int v = 0;
+	for (int pl = 0; pl < BITPLANE_CNT; pl++)
+		if (enc.bitplane[pl][y * DISPLAY_WIDTH + word_col(x)] & (BIT_R1 << ch))
+			v |= 1 << pl;
+	return v;
+}
+
+// For a constant input, the dithered output averaged over the Bayer period
+// must give the intensity of the table within 1 LSB of the 8 bit input, half
+// a LSB of the BITPLANE_CNT bit output: over the 4x4 pattern in spatial
+// mode, over 16 frames at each pixel in temporal mode. Plain truncation is
+// off by up to 1 output LSB.
+static void test_dither_mean() {
+	static int sum[4][4][3];
+	const float lsb = 1 << (16 - BITPLANE_CNT);
+
+	for (int gamma = 0; gamma <= 1; gamma++) {
+		for (int dither = 1; dither <= 2; dither++) {
+			float max_err = 0;
+			for (int v = 0; v < 256; v++) {
+				setAll(0, 0xFF000000 | 0x010101 * v);
+				setAll(1, 0);
+				setAll(2, 0);
+				enc_setup(gamma, dither, 0);
+				memset(sum, 0, sizeof(sum));
+				int n_frames = dither == 2 ? 16 : 1;
+				for (int frm = 0; frm < n_frames; frm++) {
+					enc_update(&enc, frm);
+					for (int y = 0; y < 4; y++)
+						for (int x = 0; x < 4; x++)
+							for (int ch = 0; ch < 3; ch++)
+								sum[y][x][ch] += enc_value(x, y, ch);
+				}
+
+				for (int ch = 0; ch < 3; ch++) {
+					// the top of the range is clipped to the largest value
+					float target = fminf(
+						enc.lut[ch][v] / lsb, (1 << BITPLANE_CNT) - 1
+					);
+					float mean = 0;
+					for (int y = 0; y < 4; y++) {
+						for (int x = 0; x < 4; x++) {
+							float m = (float)sum[y][x][ch] / n_frames;
+							if (dither == 2)
+								max_err = fmaxf(max_err, fabsf(m - target));
+							mean += m / 16;
+						}
+					}
+					max_err = fmaxf(max_err, fabsf(mean - target));
+				}
+			}
+			// [LSB of the 8 bit input]
+			max_err *= 1 << (8 - BITPLANE_CNT);
+			if (max_err > 1)
+				printf("gamma %d, dither %d: error %.2f LSB\n", gamma, dither, max_err);
+			check(max_err <= 1, "dithered mean");
+		}
+	}
+}
+
+// a linear calibration must give the same table as is_gamma = false, the
+// built in curve must stay untouched with unity gain
+static void test_calibration() {
+	panel_encoder_t e;
+	enc_init(&e, true, 0);
+	enc_calibrate(&e, 0, 1, 1, 0);
+	enc_calibrate(&e, 1, 1, 0, 0);
+	enc_calibrate(&e, 2, 0.5, 0, 0.01);
+	bool is_ok = true;
+	for (int i = 0; i < 256; i++) {
+		if (e.lut[0][i] != i * 257 || e.lut[1][i] != valToPwm16(i))
+			is_ok = false;
+		int b = i ? (0.01 + 0.99 * valToPwm16(i) / 65535.0) * 0.5 * 65535 : 0;
+		if (abs(e.lut[2][i] - b) > 1)
+			is_ok = false;
+	}
+	check(is_ok, "calibration table");
+}
+
+// the current estimate of the encoder must match the on-time of all LEDs
+// measured by the virtual panel
+static void test_current() {
+	static float lin[DISPLAY_WIDTH * DISPLAY_HEIGHT * 3];
+
+	for (int n_lsb = 0; n_lsb <= 3; n_lsb += 3) {
+		for (int n = 0; n < N_FRAMES; n++) {
+			fill_frame(n);
+			enc_setup(false, 0, n_lsb);
+			enc_set_brightness(&enc, 64);
+			enc_update(&enc, 0);
+			vpanel_run(&enc, lin);
+
+			double on = 0;
+			for (int i = 0; i < DISPLAY_WIDTH * DISPLAY_HEIGHT * 3; i++)
+				on += lin[i];
+			double ma = 10.0 * on / enc.bcm.len / enc_bitplane_words(&enc);
+			double est = enc_current(&enc, 64, 10.0);
+			if (fabs(est / ma - 1) > 0.02)
+				printf("lsb %d, frame %d: %.1f / %.1f mA\n", n_lsb, n, est, ma);
+			check(fabs(est / ma - 1) <= 0.02, "current estimate");
+		}
+	}
+}
+
+// largest layout of test_layouts() [pixels]
+#define LAYOUT_MAX (128 * 64)
+
+// every framebuffer pixel of a layout must be driven by exactly one half of
+// one DMA word
+static void check_map_once(const panel_layout_t *l, const layout_map_t *m) {
+	static int cnt[LAYOUT_MAX];
+	const int n = l->width * l->height;
+	memset(cnt, 0, sizeof(cnt));
+	bool is_ok = true;
+	for (int w = 0; w < n / 2; w++) {
+		if (m[w].top >= n || m[w].bot >= n) {
+			is_ok = false;
+			continue;
+		}
+		cnt[m[w].top]++;
+		cnt[m[w].bot]++;
+	}
+	for (int i = 0; i < n; i++)
+		if (cnt[i] != 1)
+			is_ok = false;
+	check(is_ok, "layout map covers each pixel once");
+}
+
+// word `w` carries pixel x, y in the upper (`is_bot` false) or lower half
+static void check_map_at(
+	const panel_layout_t *l, const layout_map_t *m, int w, bool is_bot, int x,
+	int y
+) {
+	int i = is_bot ? m[w].bot : m[w].top;
+	if (i != x + y * l->width)
+		printf("word %d: pixel %d expected, got %d\n", w, x + y * l->width, i);
+	check(i == x + y * l->width, "layout map position");
+}
+
+// 1/8 scan zigzag panels, a serpentine chain of 2 x 2 panels, a 64x64 panel
+// and 2 x 2 panels of 64x32. The last two need a framebuffer of their size
+// (encoder_test64 is built for 64x64).
+static void test_layouts() {
+	static layout_map_t m[LAYOUT_MAX / 2];
+
+	// 2 x 64x32, 1/8 scan: 256 words per row address, 128 per panel
+	panel_layout_t zz = {
+		.panel_w = 64, .panel_h = 32, .scan = 8, .pattern = SCAN_ZIGZAG8,
+		.cols = 2, .rows = 1,
+	};
+	check(
+		layout_init(&zz) == 0 && layout_build_map(&zz, m) == 0,
+		"zigzag8 layout"
+	);
+	check_map_once(&zz, m);
+	// rows 0 .. 7 of a half go to the second block of 8 in the register
+	check_map_at(&zz, m, 8, false, 0, 0);
+	check_map_at(&zz, m, 0, false, 0, 8);
+	check_map_at(&zz, m, 17, false, 9, 8);
+	check_map_at(&zz, m, 1 * 256 + 128 + 14, true, 70, 17);
+
+	// 2 x 2 of 32x16, 1/8 scan: the lower row of panels is chained right to
+	// left and upside down. 128 words per row address, 32 per panel
+	panel_layout_t sp = {
+		.panel_w = 32, .panel_h = 16, .scan = 8, .pattern = SCAN_DIRECT,
+		.cols = 2, .rows = 2, .is_serpentine = true,
+	};
+	check(
+		layout_init(&sp) == 0 && layout_build_map(&sp, m) == 0,
+		"serpentine layout"
+	);
+	check_map_once(&sp, m);
+	check_map_at(&sp, m, 3 * 128 + 5, false, 5, 3);
+	check_map_at(&sp, m, 7 * 128 + 3 * 32 + 31, true, 0, 16);
+	check_map_at(&sp, m, 2 * 32, false, 63, 31);
+
+	// 64x64, 1/32 scan with the E line: 64 words per row address
+	panel_layout_t p64 = {
+		.panel_w = 64, .panel_h = 64, .scan = 32, .pattern = SCAN_DIRECT,
+		.cols = 1, .rows = 1,
+	};
+	check(
+		layout_init(&p64) == 0 && layout_build_map(&p64, m) == 0,
+		"64x64 layout"
+	);
+	check_map_once(&p64, m);
+	check_map_at(&p64, m, 31 * 64 + 5, false, 5, 31);
+	check_map_at(&p64, m, 31 * 64 + 5, true, 5, 63);
+	check_map_at(&p64, m, 17 * 64, true, 0, 49);
+
+	// 2 x 2 of 64x32, 1/16 scan: 256 words per row address, 64 per panel
+	panel_layout_t q = {
+		.panel_w = 64, .panel_h = 32, .scan = 16, .pattern = SCAN_DIRECT,
+		.cols = 2, .rows = 2,
+	};
+	check(
+		layout_init(&q) == 0 && layout_build_map(&q, m) == 0,
+		"2 x 2 64x32 layout"
+	);
+	check_map_once(&q, m);
+	check_map_at(&q, m, 5 * 256 + 2 * 64 + 10, false, 10, 37);
+	check_map_at(&q, m, 5 * 256 + 2 * 64 + 10, true, 10, 53);
+	check_map_at(&q, m, 15 * 256 + 3 * 64 + 63, true, 127, 63);
+}
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void bench(int dither, int n_lsb) {
+	const int N = 200;
+	fill_frame(2);
+	enc_setup(true, dither, n_lsb);
+	enc_set_brightness(&enc, 60);
+
+	double t = now();
+	for (int i = 0; i < N; i++)
+		enc_update(&enc, i);
+	t = now() - t;
+
+	printf(
+		"bench dither: %d, bcm_lsb_planes: %d: %7.1f us / frame\n", dither,
+		n_lsb, t / N * 1e6
+	);
+}
+
+int main(int argc, char *args[]) {
+	bool is_print = argc > 1 && strcmp(args[1], "-g") == 0;
+
+	enc.layout = (panel_layout_t){
+		.panel_w = DISPLAY_WIDTH / 2, .panel_h = DISPLAY_HEIGHT,
+		.scan = DISPLAY_HEIGHT / 2, .pattern = SCAN_DIRECT,
+		.cols = 2, .rows = 1,
+	};
+	if (layout_init(&enc.layout) || layout_build_map(&enc.layout, map)) {
+		printf("layout error\n");
+		return 1;
+	}
+	enc.map = map;
+	for (int pl = 0; pl < BITPLANE_CNT; pl++)
+		enc.bitplane[pl] = malloc(BITPLANE_MAX * 2);
+
+	if (is_print) {
+		test_golden(true);
+		return 0;
+	}
+
+	test_reference();
+	test_patch_oe();
+	test_golden(false);
+	test_vpanel();
+	test_dither_mean();
+	test_calibration();
+	test_current();
+	test_layouts();
+
+	bench(0, 0);
+	bench(2, 0);
+	bench(0, 3);
+
+	printf("%s, %d failures\n", n_fail ? "FAILED" : "PASSED", n_fail);
+	return n_fail ? 1 : 0;
+}
@@ -0,0 +1,98 @@
+// Minimal .png writer, using stored (uncompressed) deflate blocks
+#include "png.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t crc_tab[256];
+
+static uint32_t crc32(uint32_t crc, const uint8_t *p, size_t n) {
+	if (crc_tab[1] == 0) {
+		for (uint32_t i = 0; i < 256; i++) {
+			uint32_t c = i;
+			for (int k = 0; k < 8; k++)
+				c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+			crc_tab[i] = c;
+		}
+	}
+	crc = ~crc;
+	while (n--)
+		crc = crc_tab[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static void
+write_chunk(FILE *f, const char *type, const uint8_t *dat, uint32_t n) {
+	uint8_t buf[4];
+	put32(buf, n);
+	fwrite(buf, 1, 4, f);
+	fwrite(type, 1, 4, f);
+	fwrite(dat, 1, n, f);
+	uint32_t crc = crc32(crc32(0, (const uint8_t *)type, 4), dat, n);
+	put32(buf, crc);
+	fwrite(buf, 1, 4, f);
+}
+
+int png_write(const char *fName, const uint8_t *rgb, int w, int h) {
+	FILE *f = fopen(fName, "wb");
+	if (f == NULL) {
+		perror(fName);
+		return -1;
+	}
+
+	// raw scanlines, each prefixed with filter type 0
+	size_t line_len = w * 3 + 1;
+	size_t raw_len = line_len * h;
+	uint8_t *raw = malloc(raw_len);
+	for (int y = 0; y < h; y++) {
+		raw[y * line_len] = 0;
+		memcpy(&raw[y * line_len + 1], &rgb[y * w * 3], w * 3);
+	}
+
+	// zlib stream of stored blocks of max. 65535 bytes
+	size_t n_blocks = raw_len / 65535 + 1;
+	uint8_t *z = malloc(raw_len + n_blocks * 5 + 6);
+	uint8_t *p = z;
+	*p++ = 0x78;
+	*p++ = 0x01;
+	uint32_t s1 = 1, s2 = 0;
+	for (size_t i = 0; i < raw_len; i++) {
+		s1 = (s1 + raw[i]) % 65521;
+		s2 = (s2 + s1) % 65521;
+	}
+	for (size_t i = 0; i < raw_len || i == 0; i += 65535) {
+		size_t n = raw_len - i > 65535 ? 65535 : raw_len - i;
+		*p++ = i + n >= raw_len;  // BFINAL
+		*p++ = n;
+		*p++ = n >> 8;
+		*p++ = ~n;
+		*p++ = ~n >> 8;
+		memcpy(p, &raw[i], n);
+		p += n;
+	}
+	put32(p, (s2 << 16) | s1);
+	p += 4;
+
+	uint8_t ihdr[13] = {0};
+	put32(&ihdr[0], w);
+	put32(&ihdr[4], h);
+	ihdr[8] = 8;  // bit depth
+	ihdr[9] = 2;  // truecolor RGB
+
+	fwrite("\x89PNG\r\n\x1a\n", 1, 8, f);
+	write_chunk(f, "IHDR", ihdr, sizeof(ihdr));
+	write_chunk(f, "IDAT", z, p - z);
+	write_chunk(f, "IEND", NULL, 0);
+
+	free(z);
+	free(raw);
+	fclose(f);
+	return 0;
+}
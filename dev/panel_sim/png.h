@@ -0,0 +1,9 @@
+#ifndef PNG_H
+#define PNG_H
+#include <stdint.h>
+
+// Writes an 8 bit RGB image to a .png file. Uncompressed (stored deflate
+// blocks), no dependencies. Returns 0 on success
+int png_write(const char *fName, const uint8_t *rgb, int w, int h);
+
+#endif
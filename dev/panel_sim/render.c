@@ -0,0 +1,107 @@
+// Renders a background shader through the bitplane encoder and the virtual
+// panel into a .png. The upper half shows the framebuffer, the lower half
+// what the panel shows, so encoder and OE timing errors are easy to spot.
+//
+// usage: ./render out.png [shader] [frames] [brightness] [bcm_lsb_planes]
+//                 [dither] [is_gamma]
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "common.h"
+#include "frame_buffer.h"
+#include "panel_encoder.h"
+#include "png.h"
+#include "shaders.h"
+#include "vpanel.h"
+
+#define BITPLANE_SZ (DISPLAY_WIDTH * DISPLAY_HEIGHT / 2)
+#define SCALE 4
+
+void (*shader_fcts[])(unsigned frm) = {
+	drawXorFrame,		 drawBendyFrame, drawAlienFlameFrame,
+	drawDoomFlameFrame, drawLasers,
+};
+#define N_SHADERS (sizeof(shader_fcts) / sizeof(shader_fcts[0]))
+
+static panel_encoder_t enc;
+static layout_map_t map[BITPLANE_SZ];
+static float lin[DISPLAY_WIDTH * DISPLAY_HEIGHT * 3];
+static uint8_t fb_rgb[DISPLAY_WIDTH * DISPLAY_HEIGHT * 3];
+static uint8_t panel_rgb[DISPLAY_WIDTH * DISPLAY_HEIGHT * 3];
+static uint8_t out[DISPLAY_WIDTH * SCALE * DISPLAY_HEIGHT * SCALE * 2 * 3];
+
+// nearest neighbour upscaling into the output image, starting at row `y0`
+static void blit(const uint8_t *rgb, int y0) {
+	const int w = DISPLAY_WIDTH * SCALE;
+	for (int y = 0; y < DISPLAY_HEIGHT * SCALE; y++)
+		for (int x = 0; x < w; x++)
+			for (int c = 0; c < 3; c++)
+				out[((y + y0) * w + x) * 3 + c] =
+					rgb[((y / SCALE) * DISPLAY_WIDTH + x / SCALE) * 3 + c];
+}
+
+int main(int argc, char *args[]) {
+	if (argc < 2) {
+		printf(
+			"usage: %s out.png [shader] [frames] [brightness] "
+			"[bcm_lsb_planes] [dither] [is_gamma]\n",
+			args[0]
+		);
+		return 1;
+	}
+	unsigned shader = argc > 2 ? atoi(args[2]) : 0;
+	int n_frames = argc > 3 ? atoi(args[3]) : 100;
+	int br = argc > 4 ? atoi(args[4]) : 60;
+	int n_lsb = argc > 5 ? atoi(args[5]) : 0;
+	int dither = argc > 6 ? atoi(args[6]) : 0;
+	bool is_gamma = argc > 7 ? atoi(args[7]) : true;
+
+	if (shader >= N_SHADERS) {
+		printf("shader must be < %d\n", (int)N_SHADERS);
+		return 1;
+	}
+
+	enc.layout = (panel_layout_t){
+		.panel_w = DISPLAY_WIDTH / 2, .panel_h = DISPLAY_HEIGHT,
+		.scan = DISPLAY_HEIGHT / 2, .pattern = SCAN_DIRECT,
+		.cols = 2, .rows = 1,
+	};
+	if (layout_init(&enc.layout) || layout_build_map(&enc.layout, map))
+		return 1;
+	enc.map = map;
+	for (int pl = 0; pl < BITPLANE_CNT; pl++)
+		enc.bitplane[pl] = calloc(BITPLANE_SZ + DISPLAY_WIDTH, 2);
+	bcm_schedule_init(&enc.bcm, BITPLANE_CNT, n_lsb);
+	enc_init(&enc, is_gamma, dither);
+	enc_set_brightness(&enc, br);
+
+	for (int i = 0; i <= n_frames; i++)
+		shader_fcts[shader](i);
+
+	for (int i = 0; i < DISPLAY_WIDTH * DISPLAY_HEIGHT; i++) {
+		unsigned c = getBlendedPixelRawIdx(i);
+		fb_rgb[i * 3 + 0] = GR(c);
+		fb_rgb[i * 3 + 1] = GG(c);
+		fb_rgb[i * 3 + 2] = GB(c);
+	}
+
+	enc_update(&enc, n_frames);
+	vpanel_run(&enc, lin);
+	vpanel_to_rgb8(&enc, lin, panel_rgb);
+
+	// mean absolute error between framebuffer and panel
+	double err = 0;
+	for (int i = 0; i < DISPLAY_WIDTH * DISPLAY_HEIGHT * 3; i++)
+		err += abs(fb_rgb[i] - panel_rgb[i]);
+	printf(
+		"slots: %d, full scale: %.0f clocks / refresh, mean error: %.2f\n",
+		enc.bcm.len, vpanel_full_scale(&enc),
+		err / (DISPLAY_WIDTH * DISPLAY_HEIGHT * 3)
+	);
+
+	blit(fb_rgb, 0);
+	blit(panel_rgb, DISPLAY_HEIGHT * SCALE);
+	return png_write(
+		args[1], out, DISPLAY_WIDTH * SCALE, DISPLAY_HEIGHT * SCALE * 2
+	);
+}
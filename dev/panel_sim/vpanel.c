@@ -0,0 +1,136 @@
+// Virtual HUB75 panel, decodes the DMA bitplanes back into an image
+#include "vpanel.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define RGB_BITS (BIT_R1 | BIT_G1 | BIT_B1 | BIT_R2 | BIT_G2 | BIT_B2)
+
+static unsigned get_addr(unsigned v) {
+	unsigned a = 0;
+	if (v & BIT_A)
+		a |= 1;
+	if (v & BIT_B)
+		a |= 2;
+	if (v & BIT_C)
+		a |= 4;
+	if (v & BIT_D)
+		a |= 8;
+	if (v & BIT_E)
+		a |= 16;
+	return a;
+}
+
+// Accumulate one pixel clock of on-time for the latched row at `addr`
+static void
+light_row(const panel_encoder_t *e, const uint8_t *latch, int addr, float *lin) {
+	const int row_len = e->layout.row_len;
+	const layout_map_t *m = &e->map[(addr % e->layout.scan) * row_len];
+	for (int k = 0; k < row_len; k++, m++) {
+		unsigned v = latch[k];
+		if (!v)
+			continue;
+		if (m->top != 0xFFFF) {
+			lin[m->top * 3 + 0] += (v & BIT_R1) != 0;
+			lin[m->top * 3 + 1] += (v & BIT_G1) != 0;
+			lin[m->top * 3 + 2] += (v & BIT_B1) != 0;
+		}
+		if (m->bot != 0xFFFF) {
+			lin[m->bot * 3 + 0] += (v & BIT_R2) != 0;
+			lin[m->bot * 3 + 1] += (v & BIT_G2) != 0;
+			lin[m->bot * 3 + 2] += (v & BIT_B2) != 0;
+		}
+	}
+}
+
+void vpanel_run(const panel_encoder_t *e, float *lin) {
+	const int row_len = e->layout.row_len;
+	const int n_words = enc_bitplane_words(e);
+
+	// shift register (ring buffer, `head` = oldest word) and output latch
+	uint8_t *sr = calloc(row_len, 1);
+	uint8_t *latch = calloc(row_len, 1);
+	int head = 0, addr = 0;
+
+	memset(lin, 0, e->layout.width * e->layout.height * 3 * sizeof(float));
+
+	// The first cycle fills the shift registers and latches with the state
+	// at the end of the chain, only the second one is accumulated
+	for (int cycle = 0; cycle < 2; cycle++) {
+		for (int s = 0; s < e->bcm.len; s++) {
+			const int pl = e->bcm.slots[s];
+			for (int i = 0; i < n_words; i++) {
+				// order on the wire, undo the I2S FIFO word swap
+				unsigned v, is_lat, is_oe;
+				if (e->is_8bit) {
+					v = e->bitplane8[pl][ESP32_TX_FIFO_POSITION_ADJUST8(i)];
+					is_lat = v & BIT8_LAT;
+					is_oe = !(v & BIT8_OE_N);
+				} else {
+					v = e->bitplane[pl][ESP32_TX_FIFO_POSITION_ADJUST(i)];
+					is_lat = v & BIT_LAT;
+					is_oe = !(v & BIT_OE_N);
+					addr = get_addr(v);
+				}
+
+				sr[head] = v & RGB_BITS;
+				head = (head + 1) % row_len;
+
+				// the word sent first ends up at the far end of the chain
+				if (is_lat) {
+					for (int k = 0; k < row_len; k++)
+						latch[k] = sr[(head + k) % row_len];
+
+					// 8 bit mode: the EOF interrupt of the row sets the
+					// address of the row just latched. Assumes no latency.
+					if (e->is_8bit)
+						addr = i / row_len % e->layout.scan;
+				}
+
+				if (cycle && is_oe)
+					light_row(e, latch, addr, lin);
+			}
+		}
+	}
+
+	free(sr);
+	free(latch);
+}
+
+float vpanel_full_scale(const panel_encoder_t *e) {
+	float n = 0;
+	for (int s = 0; s < e->bcm.len; s++) {
+		int pl = e->bcm.slots[s];
+		n += e->oe_stop[pl] - e->oe_start[pl];
+	}
+	return n;
+}
+
+void vpanel_to_rgb8(const panel_encoder_t *e, const float *lin, uint8_t *rgb) {
+	const int n = e->layout.width * e->layout.height * 3;
+	const float full = vpanel_full_scale(e);
+	const float q_max = (1 << BITPLANE_CNT) - 1;
+
+	for (int i = 0; i < n; i++) {
+		if (full <= 0) {
+			rgb[i] = 0;
+			continue;
+		}
+		// center of the quantization step in the 16 bit intensity scale
+		float target = lin[i] / full * q_max * (1 << (16 - BITPLANE_CNT)) +
+			(1 << (15 - BITPLANE_CNT));
+
+		// closest entry of the intensity table
+		int best = 0;
+		float best_err = 1e9;
+		for (int v = 0; v < 256; v++) {
+			float err = e->lut[i % 3][v] - target;
+			if (err < 0)
+				err = -err;
+			if (err < best_err) {
+				best_err = err;
+				best = v;
+			}
+		}
+		rgb[i] = best;
+	}
+}
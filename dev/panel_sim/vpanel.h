@@ -0,0 +1,26 @@
+#ifndef VPANEL_H
+#define VPANEL_H
+#include <stdint.h>
+#include "panel_encoder.h"
+
+// Virtual HUB75 panel. Replays the bitplanes in the order of the DMA
+// descriptor chain and simulates the shift registers, the latch, the row
+// address lines and the output enable, like the real panel does.
+
+// Runs one refresh cycle (all slots of the BCM schedule) and returns the
+// on-time of each LED [pixel clocks per refresh] in `lin`, 3 floats (R, G, B)
+// per pixel of the layout.width x layout.height framebuffer. Pixels lit on
+// the wrong row (address / OE timing errors) end up where the panel would
+// show them.
+void vpanel_run(const panel_encoder_t *e, float *lin);
+
+// On-time of a LED [pixel clocks per refresh] for a full scale channel
+// value, at the brightness currently encoded
+float vpanel_full_scale(const panel_encoder_t *e);
+
+// Converts the on-times of vpanel_run() back to 8 bit channel values,
+// through the inverse of the encoders intensity tables. With gamma
+// correction enabled, this gives the perceived image.
+void vpanel_to_rgb8(const panel_encoder_t *e, const float *lin, uint8_t *rgb);
+
+#endif
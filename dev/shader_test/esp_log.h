@@ -2,8 +2,15 @@
 
 #include <stdio.h>
 
-#define ESP_LOGE(T, format, ...) printf(format "\n", ##__VA_ARGS__)
-#define ESP_LOGW(T, format, ...) printf(format "\n", ##__VA_ARGS__)
-#define ESP_LOGI(T, format, ...) printf(format "\n", ##__VA_ARGS__)
-#define ESP_LOGD(T, format, ...) printf(format "\n", ##__VA_ARGS__)
-#define ESP_LOGV(T, format, ...) printf(format "\n", ##__VA_ARGS__)
+// The tag is evaluated, so the per file tags don't show up as unused
+
+#define ESP_LOGE(T, format, ...) \
+	((void)(T), printf(format "\n", ##__VA_ARGS__))
+#define ESP_LOGW(T, format, ...) \
+	((void)(T), printf(format "\n", ##__VA_ARGS__))
+#define ESP_LOGI(T, format, ...) \
+	((void)(T), printf(format "\n", ##__VA_ARGS__))
+#define ESP_LOGD(T, format, ...) \
+	((void)(T), printf(format "\n", ##__VA_ARGS__))
+#define ESP_LOGV(T, format, ...) \
+	((void)(T), printf(format "\n", ##__VA_ARGS__))
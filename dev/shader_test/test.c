@@ -13,6 +13,11 @@
 #include "common.h"
 #include "font.h"
 
+#ifdef VPANEL
+	#include "panel_encoder.h"
+	#include "vpanel.h"
+#endif
+
 #ifdef __EMSCRIPTEN__
 	#include "emscripten.h"
 	#include "emscripten/html5.h"
@@ -77,6 +82,30 @@ static void init_sdl()
 	// );
 }
 
+#ifdef VPANEL
+static panel_encoder_t enc;
+static layout_map_t vp_map[DISPLAY_WIDTH * DISPLAY_HEIGHT / 2];
+static float vp_lin[DISPLAY_WIDTH * DISPLAY_HEIGHT * 3];
+static uint8_t vp_rgb[DISPLAY_WIDTH * DISPLAY_HEIGHT * 3];
+
+static void init_vpanel()
+{
+	enc.layout = (panel_layout_t){
+		.panel_w = DISPLAY_WIDTH / 2, .panel_h = DISPLAY_HEIGHT,
+		.scan = DISPLAY_HEIGHT / 2, .pattern = SCAN_DIRECT,
+		.cols = 2, .rows = 1,
+	};
+	layout_init(&enc.layout);
+	layout_build_map(&enc.layout, vp_map);
+	enc.map = vp_map;
+	bcm_schedule_init(&enc.bcm, BITPLANE_CNT, 0);
+	for (int pl = 0; pl < BITPLANE_CNT; pl++)
+		enc.bitplane[pl] = calloc(enc_bitplane_words(&enc), 2);
+	enc_init(&enc, true, 0);
+	enc_set_brightness(&enc, DISPLAY_WIDTH - 2);
+}
+#endif
+
 bool is_running = true;
 
 void one_iter()
@@ -117,10 +146,21 @@ void one_iter()
 	// SDL_Texture *tex = SDL_CreateTextureFromSurface(rr, surf);
 	// SDL_RenderCopy(rr, tex, NULL, &dst_rect);
 
+	#ifdef VPANEL
+		enc_update(&enc, frm);
+		vpanel_run(&enc, vp_lin);
+		vpanel_to_rgb8(&enc, vp_lin, vp_rgb);
+	#endif
+
 	for (int y=0; y<DISPLAY_HEIGHT; y++) {
 		for (int x=0; x<DISPLAY_WIDTH; x++) {
-			unsigned c = getBlendedPixel(x, y);
-			SDL_SetRenderDrawColor(rr, GR(c), GG(c), GB(c), 0xFF);
+			#ifdef VPANEL
+				uint8_t *p = &vp_rgb[(x + y * DISPLAY_WIDTH) * 3];
+				SDL_SetRenderDrawColor(rr, p[0], p[1], p[2], 0xFF);
+			#else
+				unsigned c = getBlendedPixelRawIdx(x + y * DISPLAY_WIDTH);
+				SDL_SetRenderDrawColor(rr, GR(c), GG(c), GB(c), 0xFF);
+			#endif
 			SDL_RenderDrawPoint(rr, x, y);
 		}
 	}
@@ -135,6 +175,10 @@ int main(int argc, char* args[])
 {
 	init_sdl();
 
+	#ifdef VPANEL
+		init_vpanel();
+	#endif
+
 	SDL_SetRenderDrawColor(rr, 0x22, 0x22, 0x22, 0xFF);
 	SDL_RenderClear(rr);
 
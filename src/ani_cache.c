@@ -0,0 +1,77 @@
+#include "ani_cache.h"
+#include "esp_log.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const char *T = "ANI_CACHE";
+
+static void clear(ani_cache_t *c) {
+	memset(c->slot, 0, sizeof(c->slot));
+	if (c->n_slots > 0) {
+		memset(c->id, 0, c->n_slots);
+		memset(c->used, 0, c->n_slots * sizeof(uint32_t));
+	}
+	c->t = 0;
+}
+
+int ani_cache_init(ani_cache_t *c, int budget) {
+	memset(c, 0, sizeof(*c));
+	c->headerIndex = -1;
+
+	int n = budget / ANI_FRAME_SIZE;
+	if (n <= 0)
+		return -1;
+
+	c->mem = malloc(n * ANI_FRAME_SIZE);
+	c->id = malloc(n);
+	c->used = malloc(n * sizeof(uint32_t));
+	if (c->mem == NULL || c->id == NULL || c->used == NULL) {
+		ESP_LOGE(T, "Memory allocation error!");
+		free(c->mem);
+		free(c->id);
+		free(c->used);
+		c->mem = c->id = NULL;
+		c->used = NULL;
+		return -1;
+	}
+	c->n_slots = n;
+	clear(c);
+	ESP_LOGI(T, "%d frames, %d bytes", n, n * ANI_FRAME_SIZE);
+	return 0;
+}
+
+void ani_cache_select(ani_cache_t *c, int headerIndex) {
+	if (c->headerIndex == headerIndex)
+		return;
+	clear(c);
+	c->headerIndex = headerIndex;
+}
+
+const uint8_t *ani_cache_get(ani_cache_t *c, int frameId) {
+	int s = c->slot[frameId & 0xFF] - 1;
+	if (s < 0) {
+		c->n_misses++;
+		return NULL;
+	}
+	c->used[s] = ++c->t;
+	c->n_hits++;
+	return &c->mem[s * ANI_FRAME_SIZE];
+}
+
+void ani_cache_put(ani_cache_t *c, int frameId, const uint8_t *data) {
+	if (c->n_slots <= 0 || frameId <= 0 || frameId > 255 || c->slot[frameId])
+		return;
+
+	// a handful of slots, a linear search is fine
+	int s = 0;
+	for (int i = 1; i < c->n_slots; i++)
+		if (c->used[i] < c->used[s])
+			s = i;
+
+	c->slot[c->id[s]] = 0;
+	c->slot[frameId] = s + 1;
+	c->id[s] = frameId;
+	c->used[s] = ++c->t;
+	memcpy(&c->mem[s * ANI_FRAME_SIZE], data, ANI_FRAME_SIZE);
+}
@@ -0,0 +1,36 @@
+#ifndef ANI_CACHE_H
+#define ANI_CACHE_H
+#include <stdint.h>
+#include "ani_file.h"
+
+// Least recently used cache of the stored frames of an animation, in their
+// packed form. Frame tables reference the same frame many times, repeated
+// references are served from RAM. Hardware independent.
+
+typedef struct {
+	int n_slots;	  // number of frames the cache can hold
+	uint8_t *mem;	  // n_slots * ANI_FRAME_SIZE
+	uint8_t *id;	  // frameId in each slot, 0 = empty
+	uint32_t *used;	  // time of the last access of each slot
+	uint32_t t;		  // access counter
+	int headerIndex;  // animation the frames belong to
+	uint8_t slot[256]; // slot + 1 of each frameId, 0 = not cached
+
+	unsigned n_hits;
+	unsigned n_misses;
+} ani_cache_t;
+
+// Allocates as many slots as fit into `budget` bytes. Returns -1 if not even
+// one fits or memory is short. A cache with 0 slots is valid and never hits.
+int ani_cache_init(ani_cache_t *c, int budget);
+
+// Empties the cache, unless it already holds frames of `headerIndex`
+void ani_cache_select(ani_cache_t *c, int headerIndex);
+
+// Returns the cached frame or NULL
+const uint8_t *ani_cache_get(ani_cache_t *c, int frameId);
+
+// Copies a frame into the cache, replacing the least recently used one
+void ani_cache_put(ani_cache_t *c, int frameId, const uint8_t *data);
+
+#endif
@@ -0,0 +1,94 @@
+#include "ani_fat.h"
+#include "diskio_sdmmc.h"
+#include "esp_log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *T = "ANI_FAT";
+
+// the SD card is the only FAT volume, unless ani_fat_init() finds otherwise
+static int pdrv = 0;
+
+// entries of the first try at the fast seek table, and the most accepted.
+// Each fragment of the file takes 2 entries.
+#define CLMT_START 32
+#define CLMT_MAX 1024
+
+void ani_fat_init(const sdmmc_card_t *card) {
+	BYTE drv = ff_diskio_get_pdrv_card(card);
+	if (drv == 0xFF) {
+		ESP_LOGW(T, "no FatFs volume of the SD card, assuming 0:");
+		return;
+	}
+	pdrv = drv;
+}
+
+// Builds the table which maps file offsets to clusters
+static void create_clmt(ani_fat_t *af) {
+#if FF_USE_FASTSEEK
+	int size = CLMT_START;
+	while (size <= CLMT_MAX) {
+		af->clmt = malloc(size * sizeof(DWORD));
+		if (af->clmt == NULL)
+			break;
+		af->clmt[0] = size;
+		af->fil.cltbl = af->clmt;
+		FRESULT res = f_lseek(&af->fil, CREATE_LINKMAP);
+		if (res == FR_OK) {
+			ESP_LOGI(
+				T, "fast seek: %d fragments", (int)(af->clmt[0] - 1) / 2
+			);
+			return;
+		}
+		// on FR_NOT_ENOUGH_CORE, the required size is returned
+		int required = af->clmt[0];
+		af->fil.cltbl = NULL;
+		free(af->clmt);
+		af->clmt = NULL;
+		if (res != FR_NOT_ENOUGH_CORE || required <= size)
+			break;
+		size = required;
+	}
+	ESP_LOGW(T, "fast seek not available, file is too fragmented");
+#endif
+}
+
+int ani_fat_open(ani_fat_t *af, const char *path) {
+	char fat_path[64];
+
+	memset(af, 0, sizeof(*af));
+	if (strncmp(path, "/sd/", 4) != 0)
+		return -1;
+	snprintf(fat_path, sizeof(fat_path), "%d:/%s", pdrv, &path[4]);
+
+	FRESULT res = f_open(&af->fil, fat_path, FA_READ);
+	if (res != FR_OK) {
+		ESP_LOGE(T, "f_open(%s) failed: %d", fat_path, res);
+		return -1;
+	}
+	af->is_open = true;
+	create_clmt(af);
+	return 0;
+}
+
+int ani_fat_seek(ani_fat_t *af, long pos) {
+	if (pos < 0 || pos > f_size(&af->fil))
+		return -1;
+	return f_lseek(&af->fil, pos) == FR_OK ? 0 : -1;
+}
+
+int ani_fat_read(ani_fat_t *af, void *buf, int n) {
+	UINT n_read = 0;
+	if (f_read(&af->fil, buf, n, &n_read) != FR_OK)
+		return 0;
+	return n_read;
+}
+
+void ani_fat_close(ani_fat_t *af) {
+	if (af->is_open)
+		f_close(&af->fil);
+	free(af->clmt);
+	memset(af, 0, sizeof(*af));
+}
@@ -0,0 +1,36 @@
+#ifndef ANI_FAT_H
+#define ANI_FAT_H
+#include <stdbool.h>
+#include "ff.h"
+#include "sdmmc_cmd.h"
+
+// Reads a file on the SD card through the FatFs API, bypassing newlib stdio
+// and the VFS. The cluster chain of the file is kept in a fast seek table
+// (CLMT), so seeks don't read the FAT. A read of whole sectors at a sector
+// aligned position goes straight into the buffer of the caller, as one
+// multi-block read of the card per cluster if the buffer is DMA capable.
+// Full size frames of a relaid animations.img (ani_relayout) are sector
+// aligned and are read like this. Whether this reads faster than stdio has
+// not been measured on the clock, `direct_read` switches between both.
+
+typedef struct {
+	FIL fil;
+	DWORD *clmt; // fast seek table, NULL = follow the FAT
+	bool is_open;
+} ani_fat_t;
+
+// Selects the FatFs volume of the SD card `card`, mounted on /sd
+void ani_fat_init(const sdmmc_card_t *card);
+
+// Opens `path` below /sd for reading. Returns 0 on success.
+int ani_fat_open(ani_fat_t *af, const char *path);
+
+// Returns 0 on success, like fseek()
+int ani_fat_seek(ani_fat_t *af, long pos);
+
+// Returns the number of bytes read, like fread()
+int ani_fat_read(ani_fat_t *af, void *buf, int n);
+
+void ani_fat_close(ani_fat_t *af);
+
+#endif
@@ -0,0 +1,231 @@
+#include "ani_file.h"
+#include "esp_log.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const char *T = "ANI_FILE";
+
+#define IDX_MAGIC "AIDX"
+#define IDX_VERSION 2
+
+typedef struct {
+	char magic[4];
+	uint16_t version;
+	uint16_t n; // number of valid animations
+	ani_key_t key;
+} ani_idx_header_t;
+
+int ani_read_file_header(FILE *f, fileHeader_t *fh) {
+	char tempCh[3];
+
+	if (f == NULL || fh == NULL)
+		return -1;
+
+	fseek(f, 0x00000000, SEEK_SET);
+	if (fread(tempCh, 3, 1, f) != 1 || memcmp(tempCh, "DGD", 3) != 0) {
+		ESP_LOGE(T, "Invalid file header!");
+		return -1;
+	}
+	fread(&fh->nAnimations, 2, 1, f);
+	fh->nAnimations = SWAP16(fh->nAnimations);
+	fseek(f, 0x000001EF, SEEK_SET);
+	fread(&fh->buildStr, 8, 1, f);
+	fh->buildStr[8] = '\0';
+
+	ESP_LOGI(T, "nAnimations: %d, buildStr: %s", fh->nAnimations, fh->buildStr);
+	return 0;
+}
+
+int ani_read(FILE *f, int headerIndex, ani_t *a) {
+	headerEntry_t h;
+
+	if (f == NULL || a == NULL)
+		return -1;
+
+	fseek(f, HEADER_OFFS + HEADER_SIZE * headerIndex, SEEK_SET);
+	if (fread(&h, sizeof(h), 1, f) != 1)
+		return -1;
+
+	a->headerIndex = headerIndex;
+	a->animationId = SWAP16(h.animationId);
+	a->nStoredFrames = h.nStoredFrames;
+	a->nFrameEntries = h.nFrameEntries;
+	a->width = h.width;
+	a->height = h.height;
+	if (a->width == 0 || a->height == 0) {
+		a->width = ANI_MAX_W;
+		a->height = ANI_MAX_H;
+	}
+	memcpy(a->name, h.name, sizeof(a->name));
+	a->name[sizeof(a->name) - 1] = '\0';
+
+	// the stored frames follow the frame table
+	uint32_t byteOffset = SWAP32(h.byteOffset) * HEADER_SIZE;
+	a->frameOffs = byteOffset + HEADER_SIZE;
+
+	if (a->nFrameEntries == 0 || a->nStoredFrames == 0)
+		return -1;
+	if (a->width > ANI_MAX_W || a->height > ANI_MAX_H || a->width & 1)
+		return -1;
+
+	fseek(f, byteOffset, SEEK_SET);
+	int n = a->nFrameEntries;
+	if (fread(a->frames, sizeof(frameHeaderEntry_t), n, f) != n)
+		return -1;
+
+	// Hack to sort out invalid headers
+	for (int i = 0; i < n; i++)
+		if (a->frames[i].frameDur == 0 ||
+			a->frames[i].frameId > a->nStoredFrames)
+			return -1;
+
+	return 0;
+}
+
+bool ani_is_sequential(const ani_t *a) {
+	int next = 1;
+	for (int i = 0; i < a->nFrameEntries; i++) {
+		int frameId = a->frames[i].frameId;
+		// invalid frames are not stored
+		if (frameId == 0)
+			continue;
+		if (frameId != next)
+			return false;
+		next++;
+	}
+	return true;
+}
+
+void ani_make_key(
+	ani_key_t *key, const fileHeader_t *fh, uint32_t img_size,
+	uint32_t img_mtime
+) {
+	memset(key, 0, sizeof(*key));
+	key->img_size = img_size;
+	key->img_mtime = img_mtime;
+	key->nAnimations = fh->nAnimations;
+	strncpy(key->buildStr, fh->buildStr, sizeof(key->buildStr) - 1);
+}
+
+int ani_index_build(FILE *f_img, FILE *f_idx, const ani_key_t *key) {
+	ani_idx_header_t hdr = {.magic = IDX_MAGIC, .version = IDX_VERSION};
+	ani_t *a = malloc(sizeof(ani_t));
+	ani_entry_t *entries = malloc(key->nAnimations * sizeof(ani_entry_t));
+	if (a == NULL || entries == NULL) {
+		ESP_LOGE(T, "Memory allocation error!");
+		free(a);
+		free(entries);
+		return -1;
+	}
+
+	// the records start after the largest possible list
+	uint32_t recOffs = sizeof(hdr) + key->nAnimations * sizeof(ani_entry_t);
+	fseek(f_idx, recOffs, SEEK_SET);
+
+	int n = 0;
+	for (int i = 0; i < key->nAnimations; i++) {
+		if (ani_read(f_img, i, a) != 0) {
+			ESP_LOGD(T, "%d: invalid frame table", i);
+			continue;
+		}
+		if (a->frameOffs + a->nStoredFrames * ani_frame_size(a) >
+			key->img_size) {
+			ESP_LOGD(T, "%d: frames beyond end of file", i);
+			continue;
+		}
+
+		int len = ANI_REC_SIZE(a->nFrameEntries);
+		if (fwrite(a, 1, len, f_idx) != len)
+			goto error;
+
+		entries[n++] = (ani_entry_t){
+			.recOffs = recOffs,
+			.headerIndex = i,
+			.nStoredFrames = a->nStoredFrames,
+			.nFrameEntries = a->nFrameEntries,
+		};
+		recOffs += len;
+	}
+
+	// the header goes last, an interrupted build leaves an invalid index
+	hdr.n = n;
+	hdr.key = *key;
+	fseek(f_idx, sizeof(hdr), SEEK_SET);
+	if (fwrite(entries, sizeof(ani_entry_t), n, f_idx) != n)
+		goto error;
+	fseek(f_idx, 0, SEEK_SET);
+	if (fwrite(&hdr, sizeof(hdr), 1, f_idx) != 1)
+		goto error;
+
+	ESP_LOGI(
+		T, "index: %d of %d animations are valid", n, key->nAnimations
+	);
+	free(a);
+	free(entries);
+	return n;
+
+error:
+	ESP_LOGE(T, "Writing the index failed");
+	free(a);
+	free(entries);
+	return -1;
+}
+
+int ani_index_open(ani_index_t *idx, FILE *f_idx, const ani_key_t *key) {
+	ani_idx_header_t hdr;
+
+	memset(idx, 0, sizeof(*idx));
+	if (f_idx == NULL)
+		return -1;
+
+	fseek(f_idx, 0, SEEK_SET);
+	if (fread(&hdr, sizeof(hdr), 1, f_idx) != 1 ||
+		memcmp(hdr.magic, IDX_MAGIC, 4) != 0 || hdr.version != IDX_VERSION) {
+		ESP_LOGW(T, "index: invalid header");
+		return -1;
+	}
+
+	bool is_mtime_ok = hdr.key.img_mtime == 0 || key->img_mtime == 0 ||
+		hdr.key.img_mtime == key->img_mtime;
+	if (hdr.key.img_size != key->img_size ||
+		hdr.key.nAnimations != key->nAnimations ||
+		strcmp(hdr.key.buildStr, key->buildStr) != 0 || !is_mtime_ok) {
+		ESP_LOGW(T, "index: built for a different animation file");
+		return -1;
+	}
+
+	idx->entries = malloc(hdr.n * sizeof(ani_entry_t));
+	if (idx->entries == NULL) {
+		ESP_LOGE(T, "Memory allocation error!");
+		return -1;
+	}
+	if (fread(idx->entries, sizeof(ani_entry_t), hdr.n, f_idx) != hdr.n) {
+		ESP_LOGW(T, "index: truncated");
+		ani_index_free(idx);
+		return -1;
+	}
+	idx->f = f_idx;
+	idx->n = hdr.n;
+	return 0;
+}
+
+int ani_index_load(const ani_index_t *idx, int i, ani_t *a) {
+	if (idx->f == NULL || i < 0 || i >= idx->n)
+		return -1;
+
+	const ani_entry_t *e = &idx->entries[i];
+	int len = ANI_REC_SIZE(e->nFrameEntries);
+	fseek(idx->f, e->recOffs, SEEK_SET);
+	if (fread(a, 1, len, idx->f) != len) {
+		ESP_LOGE(T, "index: read error");
+		return -1;
+	}
+	return 0;
+}
+
+void ani_index_free(ani_index_t *idx) {
+	free(idx->entries);
+	idx->entries = NULL;
+	idx->n = 0;
+}
@@ -0,0 +1,147 @@
+#ifndef ANI_FILE_H
+#define ANI_FILE_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Reader of the DGD pinball animation container (animations.img) and of its
+// index (animations.idx). Hardware independent, the tools in dev/ani_tool
+// use the same code.
+//
+// animations.img, all numbers big endian:
+//   0x000000  "DGD", nAnimations (16 bit)
+//   0x0001EF  build string, 8 characters
+//   0x00C800  header table, one HEADER_SIZE entry per animation
+//   byteOffset * HEADER_SIZE: frame table of an animation, followed by its
+//   stored frames (width * height / 2 bytes each, 2 pixels per byte)
+//
+// animations.idx holds the frame tables of all valid animations, in the
+// layout of ani_t, and a compact list of them, which is kept in RAM.
+
+#define HEADER_OFFS 0x0000C800
+#define HEADER_SIZE 0x00000200
+
+// Largest animation [pixels]. Animations with width or height 0 have this
+// size.
+#define ANI_MAX_W 128
+#define ANI_MAX_H 32
+
+// Size of the largest stored frame [bytes], 4 bit per pixel
+#define ANI_FRAME_SIZE (ANI_MAX_W * ANI_MAX_H / 2)
+
+#define SWAP16(x) ((x >> 8) | (x << 8))
+#define SWAP32(x)                                                              \
+	(((x >> 24) & 0xff) | ((x << 8) & 0xff0000) | ((x >> 8) & 0xff00) |        \
+	 ((x << 24) & 0xff000000))
+
+typedef struct {
+	uint16_t nAnimations;
+	char buildStr[9];
+} fileHeader_t;
+
+// Type of the frame header table
+typedef struct {
+	uint8_t frameId;  // 1-based frame index
+	uint8_t frameDur; // Frame duration [ms]
+} frameHeaderEntry_t;
+
+// An entry of the header table, as stored in the file
+typedef struct {
+	uint16_t animationId;
+	uint8_t unknown0; // almost always 1
+	uint8_t nStoredFrames;
+	uint32_t byteOffset;   // points to frameTable
+	uint8_t nFrameEntries; // in the frame table
+	uint8_t width;		   //[pixels]
+	uint8_t height;		   //[pixels]
+	uint8_t unknown1[9];
+	char name[32]; // zero terminated
+} __attribute__((__packed__)) headerEntry_t;
+
+// Everything needed to play an animation. The part up to `frames` is the
+// record format of animations.idx, so loading it is a single read.
+typedef struct {
+	uint16_t headerIndex; // position in the header table of animations.img
+	uint16_t animationId;
+	uint8_t nStoredFrames;
+	uint8_t nFrameEntries;
+	uint8_t width;		  //[pixels]
+	uint8_t height;		  //[pixels]
+	uint32_t frameOffs;	  // position of stored frame 1 in animations.img
+	char name[32];		  // zero terminated
+	frameHeaderEntry_t frames[255]; // the frame table
+} ani_t;
+
+#define ANI_REC_SIZE(nFrameEntries)                                            \
+	(offsetof(ani_t, frames) + (nFrameEntries) * sizeof(frameHeaderEntry_t))
+
+// Reads the file header of animations.img. Returns -1 if it is not a DGD file
+int ani_read_file_header(FILE *f, fileHeader_t *fh);
+
+// Reads header entry `headerIndex` and the frame table of an animation from
+// animations.img into `a`. Returns -1 if the frame table or the size is
+// invalid. The width must be even.
+int ani_read(FILE *f, int headerIndex, ani_t *a);
+
+// Size of a stored frame of `a` [bytes], at most ANI_FRAME_SIZE
+static inline int ani_frame_size(const ani_t *a) {
+	return a->width * a->height / 2;
+}
+
+// Position of stored frame `frameId` (1-based) in animations.img
+static inline long ani_frame_pos(const ani_t *a, int frameId) {
+	return a->frameOffs + (long)ani_frame_size(a) * (frameId - 1);
+}
+
+// True if the stored frames are in playback order, each shown once, like
+// dev/ani_tool/ani_relayout writes them. They can be read without seeking.
+bool ani_is_sequential(const ani_t *a);
+
+// ----------------------
+//  animations.idx
+// ----------------------
+// Identifies the animations.img an index was built from. An index built on
+// the host has img_mtime = 0, which is not checked.
+typedef struct {
+	uint32_t img_size;	 // [bytes]
+	uint32_t img_mtime;	 // modification time [s]
+	uint16_t nAnimations;
+	char buildStr[10];
+} ani_key_t;
+
+// RAM entry of a valid animation
+typedef struct {
+	uint32_t recOffs; // position of its ani_t record in animations.idx
+	uint16_t headerIndex;
+	uint8_t nStoredFrames;
+	uint8_t nFrameEntries;
+} ani_entry_t;
+
+typedef struct {
+	FILE *f;			  // animations.idx, open for reading
+	int n;				  // number of valid animations
+	ani_entry_t *entries; // n entries
+} ani_index_t;
+
+void ani_make_key(
+	ani_key_t *key, const fileHeader_t *fh, uint32_t img_size,
+	uint32_t img_mtime
+);
+
+// Checks all animations of `f_img` and writes the valid ones to `f_idx`,
+// which must be open for writing. Returns the number of valid animations or
+// -1 on error.
+int ani_index_build(FILE *f_img, FILE *f_idx, const ani_key_t *key);
+
+// Loads the list of valid animations from `f_idx`, which must stay open.
+// Returns -1 if the index is damaged or does not match `key`.
+int ani_index_open(ani_index_t *idx, FILE *f_idx, const ani_key_t *key);
+
+// Loads valid animation `i` (0 .. idx->n - 1) into `a`, with a single read
+int ani_index_load(const ani_index_t *idx, int i, ani_t *a);
+
+// Frees the list, does not close the file
+void ani_index_free(ani_index_t *idx);
+
+#endif
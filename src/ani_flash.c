@@ -0,0 +1,333 @@
+#include "ani_flash.h"
+#include "ani_rle.h"
+#include "common.h"
+#include "esp_log.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const char *T = "ANI_FLASH";
+
+// the animations.rle image follows the header
+#define IMG_OFFS sizeof(ani_flash_header_t)
+
+// Collects small writes into page sized ones. Sectors are erased just before
+// they are written to.
+typedef struct {
+	const esp_partition_t *part;
+	uint32_t pos;	 // partition offset of buf
+	uint32_t erased; // end of the erased part
+	int n;			 // bytes in buf
+	uint8_t buf[256];
+} writer_t;
+
+static int w_erase(writer_t *w, uint32_t end) {
+	if (end > w->part->size)
+		return -1;
+	while (w->erased < end) {
+		if (esp_partition_erase_range(
+				w->part, w->erased, w->part->erase_size
+			) != ESP_OK)
+			return -1;
+		w->erased += w->part->erase_size;
+	}
+	return 0;
+}
+
+static int w_flush(writer_t *w) {
+	if (w->n == 0)
+		return 0;
+	if (w_erase(w, w->pos + w->n) != 0 ||
+		esp_partition_write(w->part, w->pos, w->buf, w->n) != ESP_OK)
+		return -1;
+	w->pos += w->n;
+	w->n = 0;
+	return 0;
+}
+
+// Returns -1 if the partition is full or broken
+static int w_write(writer_t *w, const void *data, int len) {
+	const uint8_t *p = data;
+	while (len > 0) {
+		int n = MIN(len, (int)sizeof(w->buf) - w->n);
+		memcpy(&w->buf[w->n], p, n);
+		w->n += n;
+		p += n;
+		len -= n;
+		if (w->n == sizeof(w->buf) && w_flush(w) != 0)
+			return -1;
+	}
+	return 0;
+}
+
+// partition offset of the next byte written
+static uint32_t w_tell(const writer_t *w) {
+	return w->pos + w->n;
+}
+
+static void unmap(ani_flash_t *fc) {
+	if (fc->mem)
+		esp_partition_munmap(fc->h);
+	fc->mem = NULL;
+	fc->size = 0;
+	fc->key = 0;
+	ani_index_free(&fc->idx);
+}
+
+static int map(ani_flash_t *fc) {
+	const void *p;
+	const ani_flash_header_t *hdr;
+	const ani_rle_header_t *rle;
+
+	if (esp_partition_mmap(
+			fc->part, 0, fc->part->size, ESP_PARTITION_MMAP_DATA, &p, &fc->h
+		) != ESP_OK) {
+		ESP_LOGE(T, "mmap failed");
+		return -1;
+	}
+	fc->mem = (const uint8_t *)p + IMG_OFFS;
+
+	hdr = p;
+	rle = (const ani_rle_header_t *)fc->mem;
+	if (memcmp(hdr->magic, ANI_FLASH_MAGIC, 4) != 0 ||
+		hdr->version != ANI_FLASH_VERSION || hdr->size > fc->part->size ||
+		hdr->size < IMG_OFFS + sizeof(*rle) ||
+		memcmp(rle->magic, ANI_RLE_MAGIC, 4) != 0 ||
+		rle->version != ANI_RLE_VERSION || rle->n > ANI_FLASH_MAX ||
+		hdr->size < IMG_OFFS + sizeof(*rle) + rle->n * sizeof(ani_entry_t)) {
+		ESP_LOGI(T, "empty");
+		return 0;
+	}
+	fc->size = hdr->size - IMG_OFFS;
+
+	const int n_bytes = rle->n * sizeof(ani_entry_t);
+	fc->idx.entries = malloc(n_bytes);
+	if (fc->idx.entries == NULL) {
+		ESP_LOGE(T, "Memory allocation error!");
+		return -1;
+	}
+	memcpy(fc->idx.entries, &fc->mem[sizeof(*rle)], n_bytes);
+	fc->idx.n = rle->n;
+	fc->key = hdr->key;
+	ESP_LOGI(T, "%d animations, %d bytes", fc->idx.n, fc->size);
+	return 0;
+}
+
+int ani_flash_open(ani_flash_t *fc) {
+	memset(fc, 0, sizeof(*fc));
+	fc->part = esp_partition_find_first(
+		ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, ANI_FLASH_PARTITION
+	);
+	if (fc->part == NULL) {
+		// an update over the air keeps the old partition table
+		ESP_LOGW(
+			T, "no %s partition, flash partitions.csv over USB",
+			ANI_FLASH_PARTITION
+		);
+		return -1;
+	}
+	return map(fc);
+}
+
+// FNV-1a
+static uint32_t hash(uint32_t h, const void *data, int len) {
+	const uint8_t *p = data;
+	while (len--) {
+		h ^= *p++;
+		h *= 16777619;
+	}
+	return h;
+}
+
+uint32_t ani_flash_key(
+	const ani_index_t *idx, bool is_rle, const int *sel, int n_sel
+) {
+	const uint16_t version = ANI_FLASH_VERSION;
+
+	uint32_t h = hash(2166136261, &version, sizeof(version));
+	h = hash(h, &is_rle, sizeof(is_rle));
+	for (int k = 0; k < MIN(n_sel, ANI_FLASH_MAX); k++)
+		h = hash(h, &idx->entries[sel[k]], sizeof(ani_entry_t));
+	// 0 marks an incomplete cache
+	return h ? h : 1;
+}
+
+// Writes the frame records of `a`, read from animations.img. The stored
+// frames are coded in playback order, like dev/ani_tool/ani_compress does.
+// `bufs` holds 3 frames. Returns -1 if the SD card can't be read, -2 if
+// the partition is full.
+static int copy_img_frames(
+	writer_t *w, FILE *f, const ani_t *a, uint8_t *bufs
+) {
+	uint8_t *cur = bufs, *prev = NULL, *out = &bufs[2 * ANI_FRAME_SIZE];
+	const int size = ani_frame_size(a);
+	uint8_t hdr[ANI_RLE_REC_HDR];
+	int n_delta = 0;
+
+	for (int j = 0; j < a->nFrameEntries; j++) {
+		int frameId = a->frames[j].frameId;
+		int type = ANI_RLE_BLANK, len = 0;
+		if (frameId > 0) {
+			if (fseek(f, ani_frame_pos(a, frameId), SEEK_SET) != 0 ||
+				fread(cur, 1, size, f) != size)
+				return -1;
+			// forces a key frame, see ANI_RLE_KEY_INTERVAL
+			bool is_key = n_delta >= ANI_RLE_KEY_INTERVAL - 1;
+			len = ani_rle_encode(a, cur, is_key ? NULL : prev, out, &type);
+			n_delta = type == ANI_RLE_DELTA ? n_delta + 1 : 0;
+			// the frame becomes the previous one of the stream
+			uint8_t *tmp = prev ? prev : &bufs[ANI_FRAME_SIZE];
+			prev = cur;
+			cur = tmp;
+		}
+		hdr[0] = len;
+		hdr[1] = len >> 8;
+		hdr[2] = type;
+		if (w_write(w, hdr, sizeof(hdr)) != 0 || w_write(w, out, len) != 0)
+			return -2;
+	}
+	return 0;
+}
+
+// Copies the frame records of `a` from animations.rle
+static int copy_rle_frames(
+	writer_t *w, FILE *f, const ani_t *a, uint8_t *bufs
+) {
+	if (fseek(f, a->frameOffs, SEEK_SET) != 0)
+		return -1;
+	for (int j = 0; j < a->nFrameEntries; j++) {
+		if (fread(bufs, 1, ANI_RLE_REC_HDR, f) != ANI_RLE_REC_HDR)
+			return -1;
+		int len = ANI_RLE_REC_HDR + (bufs[0] | bufs[1] << 8);
+		if (len > ANI_RLE_REC_HDR + ANI_FRAME_SIZE ||
+			fread(&bufs[ANI_RLE_REC_HDR], 1, len - ANI_RLE_REC_HDR, f) !=
+				len - ANI_RLE_REC_HDR)
+			return -1;
+		if (w_write(w, bufs, len) != 0)
+			return -2;
+	}
+	return 0;
+}
+
+int ani_flash_update(
+	ani_flash_t *fc, const ani_index_t *idx, FILE *f, bool is_rle,
+	const int *sel, int n_sel
+) {
+	if (fc->part == NULL || f == NULL)
+		return -1;
+	n_sel = MIN(n_sel, ANI_FLASH_MAX);
+	const uint32_t key = ani_flash_key(idx, is_rle, sel, n_sel);
+	unmap(fc);
+
+	writer_t *w = calloc(1, sizeof(writer_t));
+	ani_t *a = malloc(sizeof(ani_t));
+	ani_t *rec = malloc(sizeof(ani_t));
+	uint8_t *bufs = malloc(3 * ANI_FRAME_SIZE);
+	ani_entry_t *entries = malloc(n_sel * sizeof(ani_entry_t) + 1);
+	int ret = -1, n = 0;
+	if (w == NULL || a == NULL || rec == NULL || bufs == NULL ||
+		entries == NULL) {
+		ESP_LOGE(T, "Memory allocation error!");
+		goto done;
+	}
+
+	// the list of animations goes between the headers and the records
+	w->part = fc->part;
+	w->pos = IMG_OFFS + sizeof(ani_rle_header_t) + n_sel * sizeof(ani_entry_t);
+	// invalidates the old content
+	if (w_erase(w, w->pos) != 0)
+		goto done;
+
+	// end of the last complete animation
+	uint32_t end = w_tell(w);
+	ret = 0;
+	for (int k = 0; k < n_sel && ret == 0; k++) {
+		if (ani_index_load(idx, sel[k], a) != 0) {
+			ret = -1;
+			break;
+		}
+		if (a->nFrameEntries == 0)
+			continue;
+
+		// one record per frame table entry, like ani_compress
+		const uint32_t rec_pos = w_tell(w) - IMG_OFFS;
+		memcpy(rec, a, ANI_REC_SIZE(a->nFrameEntries));
+		rec->frameOffs = rec_pos + ANI_REC_SIZE(a->nFrameEntries);
+		for (int j = 0; j < a->nFrameEntries; j++)
+			rec->frames[j].frameId = j + 1;
+		if (w_write(w, rec, ANI_REC_SIZE(a->nFrameEntries)) != 0)
+			break;
+
+		ret = is_rle ? copy_rle_frames(w, f, a, bufs)
+					 : copy_img_frames(w, f, a, bufs);
+		if (ret != 0)
+			break;
+		end = w_tell(w);
+		entries[n++] = (ani_entry_t){
+			.recOffs = rec_pos,
+			.headerIndex = idx->entries[sel[k]].headerIndex,
+			.nStoredFrames = a->nStoredFrames,
+			.nFrameEntries = a->nFrameEntries,
+		};
+	}
+	// a full partition ends the list
+	if (ret == -2)
+		ret = 0;
+	// an incomplete animation is dropped
+	w->n = end > w->pos ? end - w->pos : 0;
+	if (w_flush(w) != 0) {
+		ESP_LOGE(T, "write failed");
+		ret = -1;
+	}
+
+	ani_rle_header_t rle = {
+		.magic = ANI_RLE_MAGIC, .version = ANI_RLE_VERSION, .n = n
+	};
+	ani_flash_header_t hdr = {
+		.magic = ANI_FLASH_MAGIC,
+		.version = ANI_FLASH_VERSION,
+		.key = ret == 0 ? key : 0,
+		.size = end,
+	};
+	// the header goes last, it makes the content valid
+	if ((n > 0 && esp_partition_write(
+					  fc->part, IMG_OFFS + sizeof(rle), entries,
+					  n * sizeof(ani_entry_t)
+				  ) != ESP_OK) ||
+		esp_partition_write(fc->part, IMG_OFFS, &rle, sizeof(rle)) !=
+			ESP_OK ||
+		esp_partition_write(fc->part, 0, &hdr, sizeof(hdr)) != ESP_OK)
+		ret = -1;
+	ESP_LOGI(
+		T, "wrote %d of %d animations, %d bytes", n, n_sel, (int)hdr.size
+	);
+
+done:
+	free(w);
+	free(a);
+	free(rec);
+	free(bufs);
+	free(entries);
+	if (map(fc) != 0)
+		ret = -1;
+	return ret;
+}
+
+int ani_flash_find(const ani_flash_t *fc, int headerIndex) {
+	for (int i = 0; i < fc->idx.n; i++)
+		if (fc->idx.entries[i].headerIndex == headerIndex)
+			return i;
+	return -1;
+}
+
+int ani_flash_load(const ani_flash_t *fc, int i, ani_t *a) {
+	if (i < 0 || i >= fc->idx.n)
+		return -1;
+
+	const ani_entry_t *e = &fc->idx.entries[i];
+	const int size = ANI_REC_SIZE(e->nFrameEntries);
+	if (e->recOffs + size > fc->size)
+		return -1;
+	memcpy(a, &fc->mem[e->recOffs], size);
+	return a->frameOffs < fc->size ? 0 : -1;
+}
@@ -0,0 +1,71 @@
+#ifndef ANI_FLASH_H
+#define ANI_FLASH_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "ani_file.h"
+#include "esp_partition.h"
+
+// Copies of selected animations in the `anicache` flash partition. The
+// partition holds an ani_flash_header_t followed by an animations.rle
+// image (ani_rle.h) of the animations. It is memory mapped, so frames are
+// decoded straight from flash, without a file system or the SD card.
+//
+// The copy is written by ani_flash_update(), from animations.img or
+// animations.rle. It is only rewritten when the selection or the animations
+// on the SD card change.
+
+#define ANI_FLASH_PARTITION "anicache"
+
+#define ANI_FLASH_MAGIC "AFLC"
+#define ANI_FLASH_VERSION 2
+
+// Most animations in the cache
+#define ANI_FLASH_MAX 256
+
+typedef struct {
+	char magic[4];
+	uint16_t version;
+	uint16_t unused;
+	uint32_t key;  // ani_flash_key() of the content, 0 = incomplete
+	uint32_t size; // bytes used, including this header
+} ani_flash_header_t;
+
+typedef struct {
+	const esp_partition_t *part; // NULL if there is no such partition
+	esp_partition_mmap_handle_t h;
+	const uint8_t *mem; // the animations.rle image, NULL if not mapped
+	int size;			// of the image [bytes]
+	uint32_t key;		// of the content
+	ani_index_t idx;	// the cached animations, recOffs relative to `mem`
+} ani_flash_t;
+
+// Finds the data partition by its label, maps it and lists the cached
+// animations.
+// Returns -1 if there is no partition. An empty cache has idx.n = 0.
+int ani_flash_open(ani_flash_t *fc);
+
+// Identifies the content of a cache of the animations `sel` of `idx`, in
+// order of preference
+uint32_t ani_flash_key(
+	const ani_index_t *idx, bool is_rle, const int *sel, int n_sel
+);
+
+// Rewrites the cache with as many of the animations `sel` (positions in
+// `idx`) as fit, in this order. `f` is the file of their frames,
+// animations.rle if `is_rle`, animations.img otherwise. Takes seconds and
+// stalls everything running from flash while a sector is erased.
+// Returns -1 on errors, then the cache holds the animations copied so far.
+int ani_flash_update(
+	ani_flash_t *fc, const ani_index_t *idx, FILE *f, bool is_rle,
+	const int *sel, int n_sel
+);
+
+// Returns the position of animation `headerIndex` in fc->idx, or -1
+int ani_flash_find(const ani_flash_t *fc, int headerIndex);
+
+// Loads cached animation `i` (0 .. fc->idx.n - 1) into `a`. Its frameOffs
+// points to the first frame record, relative to fc->mem.
+int ani_flash_load(const ani_flash_t *fc, int i, ani_t *a);
+
+#endif
@@ -0,0 +1,99 @@
+#include "ani_playlist.h"
+#include "common.h"
+#include "esp_log.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *T = "ANI_PLAYLIST";
+
+int ani_playlist_init(ani_playlist_t *pl, int n, int no_repeat, int weight) {
+	memset(pl, 0, sizeof(*pl));
+	if (no_repeat < 0)
+		no_repeat = 0;
+	// leave at least one animation to choose from
+	if (no_repeat > n - 1)
+		no_repeat = n > 0 ? n - 1 : 0;
+
+	pl->weight = malloc(n);
+	pl->is_recent = calloc(n, 1);
+	pl->recent = malloc((no_repeat + 1) * sizeof(uint16_t));
+	if (pl->weight == NULL || pl->is_recent == NULL || pl->recent == NULL) {
+		ESP_LOGE(T, "Memory allocation error!");
+		ani_playlist_free(pl);
+		return -1;
+	}
+	pl->n = n;
+	pl->no_repeat = no_repeat;
+	for (int i = 0; i < n; i++)
+		ani_playlist_set_weight(pl, i, weight);
+	return 0;
+}
+
+void ani_playlist_set_weight(ani_playlist_t *pl, int i, int weight) {
+	if (i < 0 || i >= pl->n)
+		return;
+	pl->weight[i] = MIN(MAX(weight, 0), 255);
+}
+
+static bool is_candidate(
+	const ani_playlist_t *pl, int i, bool is_window, const uint8_t *allowed
+) {
+	return (!is_window || !pl->is_recent[i]) && (!allowed || allowed[i]);
+}
+
+// sum of the weights of the candidates
+static unsigned get_total(
+	const ani_playlist_t *pl, bool is_window, const uint8_t *allowed
+) {
+	unsigned total = 0;
+	for (int i = 0; i < pl->n; i++)
+		if (is_candidate(pl, i, is_window, allowed))
+			total += pl->weight[i];
+	return total;
+}
+
+int ani_playlist_next(ani_playlist_t *pl) {
+	return ani_playlist_next_of(pl, NULL);
+}
+
+int ani_playlist_next_of(ani_playlist_t *pl, const uint8_t *allowed) {
+	bool is_window = true;
+	unsigned total = get_total(pl, is_window, allowed);
+	if (total == 0) {
+		is_window = false;
+		total = get_total(pl, is_window, allowed);
+	}
+	if (total == 0)
+		return -1;
+
+	unsigned r = RAND_AB(0, total - 1);
+	int i = 0;
+	for (; i < pl->n; i++) {
+		if (!is_candidate(pl, i, is_window, allowed))
+			continue;
+		if (r < pl->weight[i])
+			break;
+		r -= pl->weight[i];
+	}
+
+	// the oldest entry leaves the window
+	if (pl->no_repeat > 0) {
+		if (pl->n_recent == pl->no_repeat)
+			pl->is_recent[pl->recent[pl->i_recent]] = 0;
+		else
+			pl->n_recent++;
+		pl->recent[pl->i_recent] = i;
+		pl->is_recent[i] = 1;
+		pl->i_recent = (pl->i_recent + 1) % pl->no_repeat;
+	}
+	return i;
+}
+
+void ani_playlist_free(ani_playlist_t *pl) {
+	free(pl->weight);
+	free(pl->is_recent);
+	free(pl->recent);
+	memset(pl, 0, sizeof(*pl));
+}
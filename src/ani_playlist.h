@@ -0,0 +1,36 @@
+#ifndef ANI_PLAYLIST_H
+#define ANI_PLAYLIST_H
+#include <stdint.h>
+
+// Chooses the next animation: weighted random, without repeating one of the
+// last `no_repeat` animations. Animations are referred to by their position
+// in the index (ani_index_t). Hardware independent.
+
+typedef struct {
+	int n;				// number of animations
+	uint8_t *weight;	// relative chance of each animation, 0 = disabled
+	uint8_t *is_recent; // played within the no-repeat window
+	uint16_t *recent;	// ring of the last played animations
+	int no_repeat;		// length of the ring
+	int n_recent;		// entries in the ring
+	int i_recent;		// next entry to write
+} ani_playlist_t;
+
+// All `n` animations get `weight`. Returns -1 if memory is short
+int ani_playlist_init(ani_playlist_t *pl, int n, int no_repeat, int weight);
+
+// Sets the weight of animation `i`, 0 disables it
+void ani_playlist_set_weight(ani_playlist_t *pl, int i, int weight);
+
+// Picks the next animation and puts it into the no-repeat window.
+// If all enabled animations are in the window, the window is ignored.
+// Returns -1 if all animations are disabled.
+int ani_playlist_next(ani_playlist_t *pl);
+
+// Like ani_playlist_next(), but only picks animation `i` if `allowed[i]` is
+// non-zero
+int ani_playlist_next_of(ani_playlist_t *pl, const uint8_t *allowed);
+
+void ani_playlist_free(ani_playlist_t *pl);
+
+#endif
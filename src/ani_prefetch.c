@@ -0,0 +1,364 @@
+#include "ani_prefetch.h"
+#include "ani_cache.h"
+#include "ani_fat.h"
+#include "ani_rle.h"
+#include "ani_stats.h"
+#include "assert.h"
+#include "common.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/queue.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const char *T = "ANI_PREFETCH";
+
+ani_prefetch_stats_t g_prefetch_stats = {0};
+
+// buffers ready to be filled and frames ready to be shown
+static QueueHandle_t q_free = NULL;
+static QueueHandle_t q_full = NULL;
+
+static TaskHandle_t t_reader = NULL;
+
+// only accessed by the reader task
+static ani_cache_t cache;
+
+// animations.rle mode: the last decoded frame and the compressed record
+static bool is_rle = false;
+static bool cur_is_rle = false;
+static uint8_t *rle_frame = NULL;
+static uint8_t *rle_rec = NULL;
+// rle_frame is undefined after a corrupt record. Deltas are skipped until the
+// next key frame. If the record boundaries got lost, the animation is stopped,
+// see ani_prefetch_get().
+static enum { RLE_OK, RLE_RESYNC, RLE_LOST } rle_state = RLE_OK;
+
+// frames are read through FatFs instead of cur_f, see ani_fat.h
+static ani_fat_t fat;
+
+// the animation being read, set before the reader is notified. Animations
+// of the flash cache are read from cur_mem instead of cur_f.
+static FILE *cur_f = NULL;
+static const uint8_t *cur_mem = NULL;
+static long mem_size = 0;
+static long mem_pos = 0;
+static const ani_t *cur_a = NULL;
+static volatile bool is_busy = false;
+static volatile bool is_abort = false;
+// the reader gave up on the animation before its last frame
+static volatile bool is_lost = false;
+
+// longest time without a frame before the reader counts as stuck [us]
+#define STUCK_TIME 1000000
+// longest wait for the reader to stop [ms]
+#define STOP_TIME 200
+
+// when ani_prefetch_get() found no frame first, 0 = not waiting [us]
+static int64_t t_wait = 0;
+
+// position of cur_f, -1 = unknown. Seeks are skipped if already there
+static long cur_pos = -1;
+
+// frames of the animation are stored in playback order, see
+// ani_is_sequential(). Each is read once, so they bypass the cache.
+static bool is_sequential = false;
+
+static int src_seek(long pos) {
+	if (cur_mem) {
+		if (pos < 0 || pos > mem_size)
+			return -1;
+		mem_pos = pos;
+		return 0;
+	}
+	if (fat.is_open)
+		return ani_fat_seek(&fat, pos);
+	return fseek(cur_f, pos, SEEK_SET);
+}
+
+static int src_read(void *buf, int n) {
+	if (cur_mem) {
+		n = MIN(n, mem_size - mem_pos);
+		memcpy(buf, &cur_mem[mem_pos], n);
+		mem_pos += n;
+		return n;
+	}
+	g_prefetch_stats.n_reads++;
+	if (fat.is_open)
+		return ani_fat_read(&fat, buf, n);
+	return fread(buf, 1, n, cur_f);
+}
+
+static int read_frame(int frameId, uint8_t *buf) {
+	// only the pixels of the animation
+	const int size = ani_frame_size(cur_a);
+
+	if (!is_sequential) {
+		const uint8_t *cached = ani_cache_get(&cache, frameId);
+		g_prefetch_stats.n_hits = cache.n_hits;
+		g_prefetch_stats.n_misses = cache.n_misses;
+		if (cached) {
+			memcpy(buf, cached, size);
+			return 0;
+		}
+	}
+
+	long pos = ani_frame_pos(cur_a, frameId);
+	int64_t t = esp_timer_get_time();
+	if (pos != cur_pos) {
+		g_prefetch_stats.n_seeks++;
+		if (src_seek(pos) != 0)
+			goto error;
+		int64_t t_seek = esp_timer_get_time();
+		ani_stats_add(ANI_LAT_SEEK, t_seek - t);
+		t = t_seek;
+	}
+	if (src_read(buf, size) != size)
+		goto error;
+	ani_stats_add(ANI_LAT_READ, esp_timer_get_time() - t);
+	cur_pos = pos + size;
+	g_prefetch_stats.n_bytes += size;
+
+	if (!is_sequential)
+		ani_cache_put(&cache, frameId, buf);
+	return 0;
+
+error:
+	cur_pos = -1;
+	g_prefetch_stats.n_errors++;
+	return -1;
+}
+
+// Reads and decodes the next record of an animations.rle stream. Returns -1
+// for blank frames, errors and frames skipped after an error.
+static int read_rle_frame(ani_frame_t *fr) {
+	uint8_t hdr[ANI_RLE_REC_HDR];
+	if (rle_state == RLE_LOST)
+		return -1;
+	int64_t t = esp_timer_get_time();
+	if (src_read(hdr, ANI_RLE_REC_HDR) != ANI_RLE_REC_HDR)
+		goto lost;
+	int len = hdr[0] | hdr[1] << 8;
+	int type = hdr[2];
+	if (len > ANI_FRAME_SIZE || type > ANI_RLE_BLANK)
+		goto lost;
+	// records in flash are decoded where they are
+	const uint8_t *rec = rle_rec;
+	if (cur_mem) {
+		if (len > mem_size - mem_pos)
+			goto lost;
+		rec = &cur_mem[mem_pos];
+		mem_pos += len;
+	} else {
+		if (src_read(rle_rec, len) != len)
+			goto lost;
+		g_prefetch_stats.n_bytes += ANI_RLE_REC_HDR + len;
+	}
+	int64_t t_read = esp_timer_get_time();
+	ani_stats_add(ANI_LAT_READ, t_read - t);
+
+	if (type == ANI_RLE_BLANK)
+		return -1;
+	if (rle_state == RLE_RESYNC) {
+		if (type == ANI_RLE_DELTA)
+			return -1;
+		rle_state = RLE_OK;
+	}
+	if (ani_rle_decode(cur_a, type, rec, len, rle_frame) != 0) {
+		ESP_LOGW(T, "corrupt frame %d, skipping to the next key frame", fr->i);
+		rle_state = RLE_RESYNC;
+		g_prefetch_stats.n_errors++;
+		return -1;
+	}
+	memcpy(fr->buf, rle_frame, ani_frame_size(cur_a));
+	fr->t_decode = esp_timer_get_time() - t_read;
+	return 0;
+
+lost:
+	ESP_LOGW(T, "can't read frame %d, stopping the animation", fr->i);
+	rle_state = RLE_LOST;
+	g_prefetch_stats.n_errors++;
+	return -1;
+}
+
+static void reader_task(void *pvParameters) {
+	while (1) {
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		ani_cache_select(&cache, cur_a->headerIndex);
+
+		// the streams are read sequentially, starting with a key frame
+		if (cur_is_rle) {
+			int64_t t = esp_timer_get_time();
+			int ret = src_seek(cur_a->frameOffs);
+			ani_stats_add(ANI_LAT_SEEK, esp_timer_get_time() - t);
+			rle_state = ret == 0 ? RLE_OK : RLE_LOST;
+		}
+		is_sequential = ani_is_sequential(cur_a);
+		// the file may have been read by someone else in between
+		cur_pos = -1;
+
+		for (int i = 0; i < cur_a->nFrameEntries; i++) {
+			ani_frame_t fr = {.i = i, .data = NULL, .t_decode = 0};
+			xQueueReceive(q_free, &fr.buf, portMAX_DELAY);
+			if (is_abort) {
+				xQueueSend(q_free, &fr.buf, 0);
+				break;
+			}
+
+			int64_t t = esp_timer_get_time();
+			int frameId = cur_a->frames[i].frameId;
+			if (cur_is_rle) {
+				if (read_rle_frame(&fr) == 0)
+					fr.data = fr.buf;
+			} else if (frameId > 0 && read_frame(frameId, fr.buf) == 0) {
+				fr.data = fr.buf;
+			}
+			t = esp_timer_get_time() - t;
+			g_prefetch_stats.sum_load += t;
+			if (t > g_prefetch_stats.max_load)
+				g_prefetch_stats.max_load = t;
+
+			xQueueSend(q_full, &fr, portMAX_DELAY);
+			if (cur_is_rle && rle_state == RLE_LOST) {
+				is_lost = true;
+				break;
+			}
+		}
+		is_busy = false;
+	}
+}
+
+void ani_prefetch_init(
+	int n_bufs, int cache_size, bool is_rle_, const char *path
+) {
+	if (n_bufs < 2)
+		n_bufs = 2;
+
+	q_free = xQueueCreate(n_bufs, sizeof(uint8_t *));
+	q_full = xQueueCreate(n_bufs, sizeof(ani_frame_t));
+	// the SD card driver reads into DMA capable memory without a bounce
+	// buffer, and in one transaction for all sectors of a frame
+	for (int i = 0; i < n_bufs; i++) {
+		uint8_t *buf = heap_caps_malloc(ANI_FRAME_SIZE, MALLOC_CAP_DMA);
+		assert(buf && "Can't allocate prefetch buffer");
+		xQueueSend(q_free, &buf, 0);
+	}
+
+	// compressed frames are decoded in playback order, a cache of stored
+	// frames doesn't apply
+	is_rle = is_rle_;
+	if (is_rle) {
+		rle_frame = malloc(ANI_FRAME_SIZE);
+		rle_rec = heap_caps_malloc(ANI_FRAME_SIZE, MALLOC_CAP_DMA);
+		assert(rle_frame && rle_rec && "Can't allocate rle buffers");
+		ani_cache_init(&cache, 0);
+	} else {
+		ani_cache_init(&cache, cache_size);
+	}
+
+	if (path && ani_fat_open(&fat, path) != 0)
+		ESP_LOGW(T, "reading %s through stdio", path);
+
+	// runs ahead of the pinball task, on the same core
+	xTaskCreatePinnedToCore(
+		&reader_task, "ani_rd", 1024 * 3, NULL, 1, &t_reader, 0
+	);
+	ESP_LOGI(
+		T, "%d x %d byte read-ahead buffers, %s", n_bufs, ANI_FRAME_SIZE,
+		fat.is_open ? "FatFs" : "stdio"
+	);
+}
+
+static void start(FILE *f, const uint8_t *mem, long size, const ani_t *a) {
+	if (!ani_prefetch_stop())
+		return;
+	if ((f == NULL && mem == NULL) || a == NULL || a->nFrameEntries == 0)
+		return;
+
+	cur_f = f;
+	cur_mem = mem;
+	mem_size = size;
+	cur_is_rle = is_rle || mem;
+	cur_a = a;
+	is_lost = false;
+	is_busy = true;
+	xTaskNotifyGive(t_reader);
+}
+
+void ani_prefetch_start(FILE *f, const ani_t *a) {
+	start(f, NULL, 0, a);
+}
+
+void ani_prefetch_start_mem(const uint8_t *mem, long size, const ani_t *a) {
+	// the flash cache is in the format of animations.rle
+	if (rle_frame == NULL) {
+		rle_frame = malloc(ANI_FRAME_SIZE);
+		if (rle_frame == NULL) {
+			ESP_LOGE(T, "Memory allocation error!");
+			return;
+		}
+	}
+	start(NULL, mem, size, a);
+}
+
+int ani_prefetch_get(ani_frame_t *fr) {
+	// a reader which didn't stop still holds the last animation
+	if (is_abort)
+		return -1;
+
+	int64_t t = esp_timer_get_time();
+	if (xQueueReceive(q_full, fr, 0) != pdTRUE) {
+		if (is_lost && !is_busy) {
+			t_wait = 0;
+			return -1;
+		}
+		if (t_wait == 0)
+			t_wait = t;
+		if (t - t_wait < STUCK_TIME)
+			return 0;
+		ESP_LOGE(T, "reader stuck");
+		t_wait = 0;
+		return -1;
+	}
+
+	// the first frame is never read ahead
+	if (t_wait != 0 && fr->i > 0) {
+		g_prefetch_stats.n_underruns++;
+		if (t - t_wait > g_prefetch_stats.max_wait)
+			g_prefetch_stats.max_wait = t - t_wait;
+	}
+	t_wait = 0;
+	g_prefetch_stats.n_frames++;
+	return 1;
+}
+
+void ani_prefetch_release(const ani_frame_t *fr) {
+	xQueueSend(q_free, &fr->buf, 0);
+}
+
+bool ani_prefetch_stop() {
+	ani_frame_t fr;
+
+	t_wait = 0;
+	if (q_full == NULL)
+		return true;
+
+	// hand back the frames read ahead, until the reader gives up. A read
+	// from a failing SD card may take longer, then the reader quits on its
+	// own and a later call finishes the job.
+	is_abort = true;
+	TickType_t t_end = xTaskGetTickCount() + STOP_TIME / portTICK_PERIOD_MS;
+	while (is_busy && (int32_t)(xTaskGetTickCount() - t_end) < 0)
+		if (xQueueReceive(q_full, &fr, 10 / portTICK_PERIOD_MS) == pdTRUE)
+			xQueueSend(q_free, &fr.buf, 0);
+	while (xQueueReceive(q_full, &fr, 0) == pdTRUE)
+		xQueueSend(q_free, &fr.buf, 0);
+	if (is_busy) {
+		ESP_LOGE(T, "reader doesn't stop");
+		return false;
+	}
+	is_abort = false;
+	return true;
+}
@@ -0,0 +1,69 @@
+#ifndef ANI_PREFETCH_H
+#define ANI_PREFETCH_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "ani_file.h"
+
+// Reads the frames of an animation ahead of playback. A reader task follows
+// the frame table and fills a ring of packed frame buffers, so SD card seek
+// and read latency overlaps with the display time of the previous frames.
+// Frames referenced more than once are served from a cache (ani_cache.h).
+// Seek and read times go to the histograms of ani_stats.h.
+
+typedef struct {
+	int i;				 // position in the frame table
+	const uint8_t *data; // ani_frame_size() bytes, NULL for an invalid frame
+	uint8_t *buf;		 // ring buffer to return with ani_prefetch_release()
+	unsigned t_decode;	 // time spent decompressing it [us]
+} ani_frame_t;
+
+typedef struct {
+	unsigned n_frames;	  // frames consumed
+	unsigned n_underruns; // frames which were not ready when needed
+	unsigned max_wait;	  // longest wait for a frame [us]
+	unsigned n_errors;	  // read errors
+	unsigned n_hits;	  // frames served from the cache
+	unsigned n_misses;	  // frames read from the SD card
+	unsigned n_bytes;	  // bytes read from the SD card
+	unsigned n_seeks;	  // reads which needed a seek first
+	unsigned n_reads;	  // read calls to the file system
+	unsigned sum_load;	  // time spent reading and decoding frames [us]
+	unsigned max_load;	  // longest time to load a frame [us]
+} ani_prefetch_stats_t;
+
+extern ani_prefetch_stats_t g_prefetch_stats;
+
+// Allocates `n_bufs` frame buffers and starts the reader task. With `is_rle`,
+// the frames are decoded from the streams of animations.rle (ani_rle.h),
+// otherwise they are read from animations.img through a cache of up to
+// `cache_size` bytes. If `path` is given, the frames are read from it
+// through FatFs (ani_fat.h) instead of the file of ani_prefetch_start().
+void ani_prefetch_init(
+	int n_bufs, int cache_size, bool is_rle, const char *path
+);
+
+// Starts reading the frames of `a` from `f`, or from `path`. Both must stay
+// valid until the last frame has been consumed or ani_prefetch_stop() returns
+// true. Does nothing if the reader can't be stopped.
+void ani_prefetch_start(FILE *f, const ani_t *a);
+
+// Starts decoding the frames of `a` from `mem`, which holds `size` bytes in
+// the format of animations.rle, like the flash cache (ani_flash.h)
+void ani_prefetch_start_mem(const uint8_t *mem, long size, const ani_t *a);
+
+// Returns 1 and the next frame if it is ready, without waiting. Returns 0 if
+// it isn't ready yet, then call again later and the wait counts as an
+// underrun. Returns -1 if the reader is stuck for more than a second (SD card
+// removed), didn't stop or lost its place in an animations.rle stream.
+int ani_prefetch_get(ani_frame_t *fr);
+
+// Hands the buffer of a frame from ani_prefetch_get() back to the reader
+void ani_prefetch_release(const ani_frame_t *fr);
+
+// Stops the reader and drops all frames read ahead. All frames from
+// ani_prefetch_get() must have been released. Waits for the reader for at
+// most 200 ms and returns false if it is still busy.
+bool ani_prefetch_stop();
+
+#endif
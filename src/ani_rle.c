@@ -0,0 +1,194 @@
+#include "ani_rle.h"
+#include "esp_log.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const char *T = "ANI_RLE";
+
+int ani_rle_open(ani_index_t *idx, FILE *f, fileHeader_t *fh) {
+	ani_rle_header_t hdr;
+
+	memset(idx, 0, sizeof(*idx));
+	if (f == NULL)
+		return -1;
+
+	fseek(f, 0, SEEK_SET);
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+		memcmp(hdr.magic, ANI_RLE_MAGIC, 4) != 0 ||
+		hdr.version != ANI_RLE_VERSION) {
+		ESP_LOGE(T, "Invalid file header!");
+		return -1;
+	}
+
+	idx->entries = malloc(hdr.n * sizeof(ani_entry_t));
+	if (idx->entries == NULL) {
+		ESP_LOGE(T, "Memory allocation error!");
+		return -1;
+	}
+	if (fread(idx->entries, sizeof(ani_entry_t), hdr.n, f) != hdr.n) {
+		ESP_LOGE(T, "truncated");
+		ani_index_free(idx);
+		return -1;
+	}
+	idx->f = f;
+	idx->n = hdr.n;
+
+	fh->nAnimations = hdr.n;
+	memcpy(fh->buildStr, hdr.buildStr, sizeof(fh->buildStr));
+	fh->buildStr[sizeof(fh->buildStr) - 1] = '\0';
+	ESP_LOGI(T, "nAnimations: %d, buildStr: %s", fh->nAnimations, fh->buildStr);
+	return 0;
+}
+
+// Decodes PackBits from `src` until `n` bytes have been written to `dst`.
+// Returns the number of bytes consumed or -1.
+static int unpack(const uint8_t *src, int len, uint8_t *dst, int n) {
+	const uint8_t *s = src, *end = src + len;
+	uint8_t *d_end = dst + n;
+
+	while (dst < d_end) {
+		if (s >= end)
+			return -1;
+		unsigned c = *s++;
+		if (c < 0x80) {
+			// literal bytes
+			c += 1;
+			if (s + c > end || dst + c > d_end)
+				return -1;
+			memcpy(dst, s, c);
+			s += c;
+		} else {
+			// repeated byte
+			c -= 0x80 - 2;
+			if (s >= end || dst + c > d_end)
+				return -1;
+			memset(dst, *s++, c);
+		}
+		dst += c;
+	}
+	return s - src;
+}
+
+int ani_rle_decode(
+	const ani_t *a, int type, const uint8_t *src, int len, uint8_t *frame
+) {
+	const int size = ani_frame_size(a), row_size = a->width / 2;
+
+	switch (type) {
+	case ANI_RLE_RAW:
+		if (len != size)
+			return -1;
+		memcpy(frame, src, size);
+		return 0;
+
+	case ANI_RLE_KEY:
+		return unpack(src, len, frame, size) == len ? 0 : -1;
+
+	case ANI_RLE_DELTA: {
+		if (len < 4)
+			return -1;
+		uint32_t mask = src[0] | src[1] << 8 | src[2] << 16 |
+			(uint32_t)src[3] << 24;
+		int pos = 4;
+		if (mask >> (a->height - 1) > 1)
+			return -1;
+		for (int y = 0; mask; y++, mask >>= 1) {
+			if (!(mask & 1))
+				continue;
+			int ret = unpack(
+				&src[pos], len - pos, &frame[y * row_size], row_size
+			);
+			if (ret < 0)
+				return -1;
+			pos += ret;
+		}
+		return pos == len ? 0 : -1;
+	}
+
+	case ANI_RLE_BLANK:
+		return len == 0 ? 0 : -1;
+	}
+	return -1;
+}
+
+// worst case size of PackBits coded data
+#define PACK_MAX(n) ((n) + ((n) + 127) / 128)
+
+// PackBits, see ani_rle.h. Returns the number of bytes written to `dst`
+static int pack(const uint8_t *src, int n, uint8_t *dst) {
+	int i = 0, o = 0;
+	while (i < n) {
+		int run = 1;
+		while (i + run < n && run < 129 && src[i + run] == src[i])
+			run++;
+		if (run >= 2) {
+			dst[o++] = 0x80 + run - 2;
+			dst[o++] = src[i];
+			i += run;
+			continue;
+		}
+
+		// literals, until the next run of 3
+		int lit = 1;
+		while (i + lit < n && lit < 128) {
+			const uint8_t *p = &src[i + lit];
+			if (i + lit + 2 < n && p[0] == p[1] && p[0] == p[2])
+				break;
+			lit++;
+		}
+		dst[o++] = lit - 1;
+		memcpy(&dst[o], &src[i], lit);
+		o += lit;
+		i += lit;
+	}
+	return o;
+}
+
+static int pack_delta(
+	const ani_t *a, const uint8_t *cur, const uint8_t *prev, uint8_t *dst
+) {
+	const int row_size = a->width / 2;
+	uint32_t mask = 0;
+	int o = 4;
+	for (int y = 0; y < a->height; y++) {
+		const uint8_t *row = &cur[y * row_size];
+		if (memcmp(row, &prev[y * row_size], row_size) == 0)
+			continue;
+		mask |= 1U << y;
+		o += pack(row, row_size, &dst[o]);
+	}
+	dst[0] = mask;
+	dst[1] = mask >> 8;
+	dst[2] = mask >> 16;
+	dst[3] = mask >> 24;
+	return o;
+}
+
+int ani_rle_encode(
+	const ani_t *a, const uint8_t *cur, const uint8_t *prev, uint8_t *out,
+	int *type
+) {
+	static uint8_t tmp[PACK_MAX(ANI_FRAME_SIZE) + 4 + 32];
+
+	int len = ani_frame_size(a);
+	*type = ANI_RLE_RAW;
+	memcpy(out, cur, len);
+
+	int n = pack(cur, len, tmp);
+	if (n < len) {
+		len = n;
+		*type = ANI_RLE_KEY;
+		memcpy(out, tmp, n);
+	}
+
+	if (prev) {
+		n = pack_delta(a, cur, prev, tmp);
+		if (n < len) {
+			len = n;
+			*type = ANI_RLE_DELTA;
+			memcpy(out, tmp, n);
+		}
+	}
+	return len;
+}
@@ -0,0 +1,76 @@
+#ifndef ANI_RLE_H
+#define ANI_RLE_H
+#include <stdint.h>
+#include <stdio.h>
+#include "ani_file.h"
+
+// Compressed animation container (animations.rle), written by
+// dev/ani_tool/ani_compress from animations.img. Hardware independent.
+//
+// All numbers little endian:
+//   ani_rle_header_t
+//   ani_entry_t[n]: list of the animations, recOffs points to their ani_t
+//   per animation: ani_t record (ANI_REC_SIZE), frameOffs points to the
+//   first frame record
+//
+// The frames of an animation are stored in playback order, one record per
+// entry of its frame table. frameId of the frame table is the position in
+// the stream, frameDur is unchanged. A frame record is a 3 byte header
+// (payload length: 16 bit, type: 8 bit) and the payload:
+//   ANI_RLE_RAW:   ani_frame_size() bytes, as in animations.img
+//   ANI_RLE_KEY:   the whole frame, PackBits coded
+//   ANI_RLE_DELTA: 32 bit mask of the changed rows (width / 2 bytes each),
+//                  then each changed row PackBits coded. Other rows stay as
+//                  in the previous frame
+//   ANI_RLE_BLANK: no payload, an invalid frame. Does not change the
+//                  previous frame
+//
+// The first frame of an animation and at least every ANI_RLE_KEY_INTERVAL-th
+// frame after it is a ANI_RLE_KEY or ANI_RLE_RAW record, so a player can
+// resynchronize after a corrupt record.
+//
+// PackBits: a control byte c < 0x80 is followed by c + 1 literal bytes,
+// c >= 0x80 by one byte, which is repeated c - 0x80 + 2 times.
+
+#define ANI_RLE_MAGIC "ARLE"
+#define ANI_RLE_VERSION 2
+
+// Maximum number of coded frames from one key frame to the next
+#define ANI_RLE_KEY_INTERVAL 16
+
+// Header of a frame record [bytes]
+#define ANI_RLE_REC_HDR 3
+
+enum { ANI_RLE_RAW, ANI_RLE_KEY, ANI_RLE_DELTA, ANI_RLE_BLANK };
+
+typedef struct {
+	char magic[4];
+	uint16_t version;
+	uint16_t n;			// number of animations
+	char buildStr[10];	// of the animations.img it was made from
+	uint8_t unused[2];
+} ani_rle_header_t;
+
+// Loads the list of animations of an animations.rle, which must stay open.
+// ani_index_load() then loads them like from animations.idx.
+// Returns -1 if it is not a valid file.
+int ani_rle_open(ani_index_t *idx, FILE *f, fileHeader_t *fh);
+
+// Decodes a frame record payload of `type` and `len` bytes of animation `a`
+// into `frame`, which holds the previous frame of the stream. Returns -1 if
+// the payload is corrupt, then `frame` is undefined until the next
+// ANI_RLE_KEY or ANI_RLE_RAW record.
+int ani_rle_decode(
+	const ani_t *a, int type, const uint8_t *src, int len, uint8_t *frame
+);
+
+// Codes frame `cur` of animation `a` as the smallest of the record types,
+// with `prev` the previous frame of the stream or NULL. Writes the payload to
+// `out`, which holds ANI_FRAME_SIZE bytes, and its type to `type`. Returns
+// the payload length. Not reentrant.
+int ani_rle_encode(
+	const ani_t *a, const uint8_t *cur, const uint8_t *prev, uint8_t *out,
+	int *type
+);
+
+#endif
@@ -0,0 +1,169 @@
+#include "ani_stats.h"
+#include "esp_log.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const char *T = "ANI_STATS";
+
+static const char *lat_names[ANI_LAT_N] = {"seek", "read", "decode", "slip"};
+
+static unsigned hist[ANI_LAT_N][ANI_HIST_BINS];
+
+// of the animation being played, filed by ani_stats_end()
+static unsigned cur_hist[ANI_LAT_N][ANI_HIST_BINS];
+static unsigned cur_max[ANI_LAT_N];
+static unsigned cur_frames, cur_late;
+
+static ani_anim_stats_t anims[ANI_STATS_N];
+static int n_anims = 0;
+
+static int get_bin(unsigned us) {
+	int bin = us ? 32 - __builtin_clz(us) : 0;
+	return bin < ANI_HIST_BINS ? bin : ANI_HIST_BINS - 1;
+}
+
+void ani_stats_add(int lat, unsigned us) {
+	if (lat < 0 || lat >= ANI_LAT_N)
+		return;
+	int bin = get_bin(us);
+	hist[lat][bin]++;
+	cur_hist[lat][bin]++;
+	if (us > cur_max[lat])
+		cur_max[lat] = us;
+	if (lat == ANI_LAT_SLIP) {
+		cur_frames++;
+		if (us > ANI_LATE_US)
+			cur_late++;
+	}
+}
+
+// true if `a` is worse than `b`
+static bool is_worse(const ani_anim_stats_t *a, const ani_anim_stats_t *b) {
+	if (a->n_late != b->n_late)
+		return a->n_late > b->n_late;
+	return a->max[ANI_LAT_SLIP] > b->max[ANI_LAT_SLIP];
+}
+
+void ani_stats_end(const ani_t *a) {
+	ani_anim_stats_t *w = NULL;
+	for (int i = 0; i < n_anims; i++)
+		if (anims[i].headerIndex == a->headerIndex &&
+			anims[i].animationId == a->animationId)
+			w = &anims[i];
+
+	if (w == NULL) {
+		// this play decides if the animation gets an entry
+		ani_anim_stats_t tmp = {.n_late = cur_late};
+		memcpy(tmp.max, cur_max, sizeof(tmp.max));
+
+		if (n_anims < ANI_STATS_N) {
+			w = &anims[n_anims++];
+		} else {
+			// replace the best of the table, if this one is worse
+			w = &anims[0];
+			for (int i = 1; i < n_anims; i++)
+				if (is_worse(w, &anims[i]))
+					w = &anims[i];
+			if (!is_worse(&tmp, w))
+				w = NULL;
+		}
+		if (w)
+			*w = (ani_anim_stats_t){
+				.animationId = a->animationId,
+				.headerIndex = a->headerIndex,
+			};
+	}
+
+	if (w) {
+		w->n_plays++;
+		w->n_frames += cur_frames;
+		w->n_late += cur_late;
+		for (int i = 0; i < ANI_LAT_N; i++) {
+			if (cur_max[i] > w->max[i])
+				w->max[i] = cur_max[i];
+			for (int k = 0; k < ANI_HIST_BINS; k++)
+				w->hist[i][k] += cur_hist[i][k];
+		}
+	}
+
+	memset(cur_hist, 0, sizeof(cur_hist));
+	memset(cur_max, 0, sizeof(cur_max));
+	cur_frames = 0;
+	cur_late = 0;
+}
+
+unsigned ani_stats_percentile(int lat, int pct) {
+	unsigned n = 0, sum = 0;
+	for (int i = 0; i < ANI_HIST_BINS; i++)
+		n += hist[lat][i];
+	if (n == 0)
+		return 0;
+	for (int i = 0; i < ANI_HIST_BINS; i++) {
+		sum += hist[lat][i];
+		if (sum * 100ULL >= (unsigned long long)n * pct)
+			return 1U << i;
+	}
+	return 1U << (ANI_HIST_BINS - 1);
+}
+
+// snprintf() to the end of buf, counts the length even if it is full
+#define APPEND(...)                                                            \
+	do {                                                                       \
+		int rest = len < size ? size - len : 0;                                \
+		int n = snprintf(rest ? &buf[len] : NULL, rest, __VA_ARGS__);          \
+		if (n > 0)                                                             \
+			len += n;                                                          \
+	} while (0)
+
+// Appends the histograms of `h` as JSON members
+static int append_hists(
+	char *buf, int size, int len, unsigned h[ANI_LAT_N][ANI_HIST_BINS]
+) {
+	for (int lat = 0; lat < ANI_LAT_N; lat++) {
+		APPEND("%s\"%s\": [", lat ? ", " : "", lat_names[lat]);
+		for (int i = 0; i < ANI_HIST_BINS; i++)
+			APPEND("%s%u", i ? ", " : "", h[lat][i]);
+		APPEND("]");
+	}
+	return len;
+}
+
+int ani_stats_json(char *buf, int size) {
+	int len = 0;
+
+	APPEND("{");
+	len = append_hists(buf, size, len, hist);
+	APPEND(", \"anims\": [");
+	for (int i = 0; i < n_anims; i++) {
+		ani_anim_stats_t *w = &anims[i];
+		APPEND(
+			"%s{\"id\": %u, \"index\": %u, \"plays\": %u, \"frames\": %u, "
+			"\"late\": %u, \"max\": [%u, %u, %u, %u], ",
+			i ? ", " : "", w->animationId, w->headerIndex, w->n_plays,
+			w->n_frames, w->n_late, w->max[0], w->max[1], w->max[2], w->max[3]
+		);
+		len = append_hists(buf, size, len, w->hist);
+		APPEND("}");
+	}
+	APPEND("]}");
+	return len;
+}
+
+void ani_stats_log() {
+	for (int lat = 0; lat < ANI_LAT_N; lat++)
+		ESP_LOGD(
+			T, "%6s p50: %6u, p99: %6u, p100: %6u us", lat_names[lat],
+			ani_stats_percentile(lat, 50), ani_stats_percentile(lat, 99),
+			ani_stats_percentile(lat, 100)
+		);
+	for (int i = 0; i < n_anims; i++) {
+		const ani_anim_stats_t *w = &anims[i];
+		ESP_LOGD(
+			T, "id %04x (%d): %u plays, %u / %u late, max slip: %u, seek: %u, "
+			"read: %u us", w->animationId, w->headerIndex, w->n_plays,
+			w->n_late, w->n_frames, w->max[ANI_LAT_SLIP], w->max[ANI_LAT_SEEK],
+			w->max[ANI_LAT_READ]
+		);
+	}
+}
@@ -0,0 +1,58 @@
+#ifndef ANI_STATS_H
+#define ANI_STATS_H
+#include <stdint.h>
+#include "ani_file.h"
+
+// Latency histograms of animation playback, kept since boot. Bin k counts
+// the samples of 2^(k-1) .. 2^k - 1 us, the last bin everything above.
+// There is one set of histograms for all animations and one per animation in
+// a table of ANI_STATS_N entries, keyed by the animation index (headerIndex).
+// When the table is full, the animation with the fewest late frames makes
+// room. Hardware independent.
+
+enum {
+	ANI_LAT_SEEK,	// fseek() on the SD card
+	ANI_LAT_READ,	// fread() of a frame or a compressed record
+	ANI_LAT_DECODE, // decompression and unpacking into the framebuffer
+	ANI_LAT_SLIP,	// how late a frame was shown, vs. the frame table
+	ANI_LAT_N
+};
+
+#define ANI_HIST_BINS 18 // up to 131 ms
+
+// A frame shown later than this is counted as late [us]
+#define ANI_LATE_US 10000
+
+// Number of animations with their own histograms
+#define ANI_STATS_N 16
+
+typedef struct {
+	uint16_t animationId;
+	uint16_t headerIndex;
+	unsigned n_plays;
+	unsigned n_frames;
+	unsigned n_late;		 // frames shown more than ANI_LATE_US late
+	unsigned max[ANI_LAT_N]; // [us]
+	unsigned hist[ANI_LAT_N][ANI_HIST_BINS];
+} ani_anim_stats_t;
+
+// Adds a sample of category `lat` [us] to the histogram. Each category must
+// only be written by one task.
+void ani_stats_add(int lat, unsigned us);
+
+// Files the samples since the last call under animation `a`
+void ani_stats_end(const ani_t *a);
+
+// Sample value below which `pct` % of the samples of all animations are [us],
+// resolution is a power of 2
+unsigned ani_stats_percentile(int lat, int pct);
+
+// Writes the histograms of all animations and of each animation of the table
+// as JSON object. Returns the length like snprintf(), so `buf` = NULL and
+// `size` = 0 return the size needed.
+int ani_stats_json(char *buf, int size);
+
+// Logs percentiles and the animations of the table, at debug level
+void ani_stats_log();
+
+#endif
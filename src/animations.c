@@ -1,4 +1,9 @@
 #include "animations.h"
+#include "ani_flash.h"
+#include "ani_playlist.h"
+#include "ani_prefetch.h"
+#include "ani_rle.h"
+#include "ani_stats.h"
 #include "common.h"
 #include "esp_log.h"
 #include "esp_timer.h"
@@ -23,169 +28,354 @@
 
 static const char *T = "ANIMATIONS";
 
-// Reads the filehader and fills `fh`
-static int getFileHeader(FILE *f, fileHeader_t *fh) {
-	char tempCh[3];
-
-	if (f == NULL || fh == NULL)
-		return -1;
-
-	fseek(f, 0x00000000, SEEK_SET);
-	fread(tempCh, 3, 1, f);
-	if (memcmp(tempCh, "DGD", 3) != 0) {
-		ESP_LOGE(T, "Invalid file header!");
-		return -1;
-	}
-	fread(&fh->nAnimations, 2, 1, f);
-	fh->nAnimations = SWAP16(fh->nAnimations);
-	fseek(f, 0x000001EF, SEEK_SET);
-	fread(&fh->buildStr, 8, 1, f);
-	fh->buildStr[8] = '\0';
+// Plays a pinball animation on layer 2, without blocking. player_step() is
+// called by aniPinballTask() when `t_next` is due and advances it by one
+// frame or fade-out step. The frames are read by the prefetch task. During
+// the fade-out, the next animation of the playlist is loaded and its first
+// frames are read ahead, so it starts without delay. Animations in the flash
+// cache are played from there. After trouble with the SD card, only those
+// are chosen for a while.
+typedef enum {
+	PL_IDLE, // no animation
+	PL_PLAY, // showing the frames
+	PL_HOLD, // keeping the last frame of a short animation for a bit
+	PL_FADE, // fading out the last frame
+} pl_state_t;
+
+typedef struct {
+	pl_state_t state;
+	TickType_t t_next; // when player_step() is due [ticks]
+	int64_t t_due;	   // when the current frame should be shown [us]
+	int i;			   // position in the frame table
+	bool is_waiting;   // for frame p->i, player_step() is due every tick
+	unsigned color;
+	frame_place_t place;
+
+	FILE *f;
+	const ani_index_t *idx;
+	ani_playlist_t *pl;
+	ani_t anis[2];
+	ani_t *ani;	 // the one playing
+	ani_t *next; // loaded and read ahead, NULL if none
+	bool is_flash;		// `ani` is played from the flash cache
+	bool is_next_flash; // `next` is
+
+	const ani_flash_t *fc;
+	uint8_t *is_cached; // of each animation of `idx`
+	int n_prefer;		// animations left to choose from the cached ones
+	int fallback;		// n_prefer after SD card trouble
+
+	ani_prefetch_stats_t st; // at the start of the animation
+	int max_draw_time;
+	int sum_draw_time;
+} player_t;
+
+static player_t player = {.state = PL_IDLE};
+
+// `f` and `idx` are the animations on the SD card, or `f` is NULL and `idx`
+// is the one of the flash cache `fc`. The cache is used after
+// player_use_cache().
+static void player_init(
+	player_t *p, FILE *f, const ani_index_t *idx, ani_playlist_t *pl,
+	const ani_flash_t *fc
+) {
+	memset(p, 0, sizeof(*p));
+	p->state = PL_IDLE;
+	p->f = f;
+	p->idx = idx;
+	p->pl = pl;
+	p->ani = &p->anis[0];
+	p->fc = fc;
+
+	cJSON *jCache = jGet(getSettings(), "anicache");
+	p->fallback = jGetI(jCache, "fallback", 10);
+}
 
-	ESP_LOGI(T, "nAnimations: %d, buildStr: %s", fh->nAnimations, fh->buildStr);
-	return 0;
+// Plays the animations found in the flash cache from there. Until then, or
+// while the cache is rewritten, all are read from the SD card.
+static void player_use_cache(player_t *p) {
+	free(p->is_cached);
+	p->is_cached = NULL;
+	if (p->fc->idx.n > 0 && p->idx->n > 0)
+		p->is_cached = calloc(p->idx->n, 1);
+	if (p->is_cached == NULL)
+		return;
+	for (int i = 0; i < p->idx->n; i++)
+		p->is_cached[i] =
+			ani_flash_find(p->fc, p->idx->entries[i].headerIndex) >= 0;
 }
 
-// Fills the headerEntry struct with data.
-// Specify an `headerIndex` from 0 to nAnimations
-static int _cur_hi = 0;
-static int readHeaderEntry(FILE *f, headerEntry_t *h, int headerIndex) {
-	if (f == NULL || h == NULL)
-		return -1;
+// Called when the SD card failed to deliver an animation in time
+static void player_sd_trouble(player_t *p) {
+	if (p->is_cached && p->n_prefer == 0)
+		ESP_LOGW(T, "SD card trouble, preferring cached animations");
+	p->n_prefer = p->fallback;
+}
 
-	_cur_hi = headerIndex;
-
-	// Copys header info into h. Note that h->nFrameEntries must be freed!
-	fseek(f, HEADER_OFFS + HEADER_SIZE * headerIndex, SEEK_SET);
-	fread(h, sizeof(*h), 1, f);
-	h->name[31] = '\0';
-	h->frameHeader = NULL;
-	h->animationId = SWAP16(h->animationId);
-	h->byteOffset = SWAP32(h->byteOffset) * HEADER_SIZE;
-	// Exract frame header
-	frameHeaderEntry_t *fh = (frameHeaderEntry_t *)malloc(
-		sizeof(frameHeaderEntry_t) * h->nFrameEntries
-	);
-	if (fh == NULL) {
-		ESP_LOGE(T, "Memory allocation error!");
+// Loads animation `i` of the playlist, from flash if it is cached
+static int player_load(player_t *p, int i, ani_t *a) {
+	int c = -1;
+	if (p->is_cached && p->is_cached[i])
+		c = ani_flash_find(p->fc, p->idx->entries[i].headerIndex);
+	p->is_next_flash = c >= 0 && ani_flash_load(p->fc, c, a) == 0;
+	if (p->is_next_flash)
+		return 0;
+	if (p->f == NULL || ani_index_load(p->idx, i, a) != 0) {
+		player_sd_trouble(p);
 		return -1;
 	}
-	h->frameHeader = fh;
-	fseek(f, h->byteOffset, SEEK_SET);
-	for (int i = 0; i < h->nFrameEntries; i++) {
-		fread(&fh->frameId, 1, 1, f);
-		fread(&fh->frameDur, 1, 1, f);
-		// Hack to sort out invalid headers
-		if (fh->frameDur <= 0 || fh->frameId > h->nStoredFrames) {
-			ESP_LOGE(T, "Invalid header!");
-			return -1;
-		}
-		fh++;
-	}
 	return 0;
 }
 
-// seek the file f to the beginning of a specific animation frame
-static void seekToFrame(FILE *f, int byteOffset, int frameId) {
-	// without fast-seek enabled, this sometimes takes hundreds of ms,
-	// resulting in choppy animation playback
-	// http://www.elm-chan.org/fsw/ff/doc/lseek.html
-	if (f == NULL || frameId <= 0)
+// Loads the next animation of the playlist and reads its first frames
+static void player_preload(player_t *p) {
+	if (p->idx->n == 0 || p->next != NULL)
 		return;
-	byteOffset += DISPLAY_WIDTH * DISPLAY_HEIGHT * (frameId - 1) / 2;
-	fseek(f, byteOffset, SEEK_SET);
-}
 
-// play a single animation, start to finish
-static void playAni(FILE *f, headerEntry_t *h) {
-	int64_t seek_time = 0;
-	int max_seek_time = 0;
+	const uint8_t *only = p->n_prefer > 0 ? p->is_cached : NULL;
+	int i = ani_playlist_next_of(p->pl, only);
+	if (i < 0 && only)
+		i = ani_playlist_next(p->pl);
+	ani_t *a = p->ani == &p->anis[0] ? &p->anis[1] : &p->anis[0];
+	if (i < 0 || player_load(p, i, a) != 0 || a->nFrameEntries == 0)
+		return;
 
-	int64_t draw_time = 0;
-	int max_draw_time = 0;
-	int sum_draw_time = 0;
+	p->st = g_prefetch_stats;
+	g_prefetch_stats.max_load = 0;
+	if (p->is_next_flash)
+		ani_prefetch_start_mem(p->fc->mem, p->fc->size, a);
+	else
+		ani_prefetch_start(p->f, a);
+	p->next = a;
+}
 
-	if (f == NULL || h == NULL || h->nFrameEntries == 0)
+// Starts playing the preloaded animation
+static void player_start(player_t *p) {
+	player_preload(p);
+	if (p->next == NULL)
 		return;
+	p->ani = p->next;
+	p->is_flash = p->is_next_flash;
+	p->next = NULL;
 
 	// get a random color
 	uint8_t r, g, b;
 	fast_hsv2rgb_32bit(
 		RAND_AB(0, HSV_HUE_MAX), HSV_SAT_MAX, HSV_VAL_MAX, &r, &g, &b
 	);
-	unsigned color = SRGBA(r, g, b, 0xFF);
-
-	// pre-seek the file to beginning of frame
-	frameHeaderEntry_t fh = h->frameHeader[0];
-	seekToFrame(f, h->byteOffset + HEADER_SIZE, fh.frameId);
-	unsigned cur_delay = fh.frameDur;
-	TickType_t xLastWakeTime = xTaskGetTickCount();
-
-	for (int i = 0; i < h->nFrameEntries; i++) {
-		draw_time = esp_timer_get_time();
-		if (fh.frameId <= 0)
-			setAll(2, 0xFF000000); // invalid frame = translucent black
-		else
-			setFromFile(f, 2, color);
-		draw_time = esp_timer_get_time() - draw_time;
-		sum_draw_time += draw_time;
-		if (draw_time > max_draw_time)
-			max_draw_time = draw_time;
-
-		// get the next frame ready in advance
-		if (i < h->nFrameEntries - 1) {
-			fh = h->frameHeader[i + 1];
-
-			seek_time = esp_timer_get_time();
-			seekToFrame(f, h->byteOffset + HEADER_SIZE, fh.frameId);
-			seek_time = esp_timer_get_time() - seek_time;
-			if (seek_time > max_seek_time)
-				max_seek_time = seek_time;
-		}
+	p->color = SRGBA(r, g, b, 0xFF);
 
-		// clip minimum delay to avoid skipping frames
-		if (cur_delay < g_f_del)
-			cur_delay = g_f_del;
+	// smaller animations are scaled up and placed on the display
+	cJSON *jAni = jGet(getSettings(), "animations");
+	set_frame_place(
+		&p->place, p->ani->width, p->ani->height, jGetI(jAni, "scale", 0),
+		jGetS(jAni, "anchor", "center")
+	);
+
+	p->max_draw_time = 0;
+	p->sum_draw_time = 0;
+
+	p->i = 0;
+	p->t_next = xTaskGetTickCount();
+	p->t_due = esp_timer_get_time();
+	p->state = PL_PLAY;
+}
 
-		// wait for N ms, measured from last call to vTaskDelayUntil()
-		vTaskDelayUntil(&xLastWakeTime, cur_delay / portTICK_PERIOD_MS);
-		cur_delay = fh.frameDur;
+// shows frame p->i
+static void player_frame(player_t *p) {
+	const ani_t *a = p->ani;
+	ani_frame_t fr;
+
+	// not read yet, try again on the next tick
+	int ret = ani_prefetch_get(&fr);
+	p->is_waiting = ret == 0;
+	if (ret == 0)
+		return;
+	if (ret < 0) {
+		p->i = a->nFrameEntries;
+		if (!p->is_flash)
+			player_sd_trouble(p);
+		return;
 	}
+
+	int64_t draw_time = esp_timer_get_time();
+	if (fr.data == NULL)
+		setAll(2, 0xFF000000); // invalid frame = translucent black
+	else
+		setFromBufPlaced(fr.data, 2, p->color, &p->place);
+	int64_t t = esp_timer_get_time();
+	draw_time = t - draw_time;
+	p->sum_draw_time += draw_time;
+	if (draw_time > p->max_draw_time)
+		p->max_draw_time = draw_time;
+	ani_prefetch_release(&fr);
+	ani_stats_add(ANI_LAT_DECODE, fr.t_decode + draw_time);
+	ani_stats_add(ANI_LAT_SLIP, t > p->t_due ? t - p->t_due : 0);
+
+	// clip minimum delay to avoid skipping frames
+	unsigned cur_delay = a->frames[p->i].frameDur;
+	if (cur_delay < g_f_del)
+		cur_delay = g_f_del;
+
+	// measured from the last step, like vTaskDelayUntil()
+	p->t_next += cur_delay / portTICK_PERIOD_MS;
+	p->t_due += cur_delay / portTICK_PERIOD_MS * portTICK_PERIOD_MS * 1000;
+	p->i++;
+}
+
+static void player_end(player_t *p) {
+	const ani_t *a = p->ani;
+	const ani_prefetch_stats_t *st = &p->st;
+
+	ani_prefetch_stop();
+	ani_stats_end(a);
+
+	// underruns and read errors mean the SD card is slow or failing
+	if (!p->is_flash && (g_prefetch_stats.n_underruns > st->n_underruns ||
+						 g_prefetch_stats.n_errors > st->n_errors))
+		player_sd_trouble(p);
+	else if (p->n_prefer > 0)
+		p->n_prefer--;
+
 	ESP_LOGD(
-		T, "%d, %s, f: %d / %d, d: %d ms, seek: %d ms, draw: %d / %d ms",
-		_cur_hi, h->name, h->nStoredFrames, h->nFrameEntries,
-		h->frameHeader->frameDur, max_seek_time / 1000,
-		sum_draw_time / h->nFrameEntries / 1000, max_draw_time / 1000
+		T, "%d, %s, %s, f: %d / %d, d: %d ms, underruns: %d, cache: %d / %d, "
+		"read: %d bytes, %d seeks, %d calls, load: %d / %d us, "
+		"draw: %d / %d us",
+		a->headerIndex, a->name, p->is_flash ? "flash" : "sd",
+		a->nStoredFrames, a->nFrameEntries,
+		a->frames[0].frameDur, g_prefetch_stats.n_underruns - st->n_underruns,
+		g_prefetch_stats.n_hits - st->n_hits,
+		g_prefetch_stats.n_misses - st->n_misses,
+		g_prefetch_stats.n_bytes - st->n_bytes,
+		g_prefetch_stats.n_seeks - st->n_seeks,
+		g_prefetch_stats.n_reads - st->n_reads,
+		(g_prefetch_stats.sum_load - st->sum_load) / a->nFrameEntries,
+		g_prefetch_stats.max_load,
+		p->sum_draw_time / a->nFrameEntries, p->max_draw_time
 	);
 }
 
-// blocks while rendering a pinball animation, with fade-out.
-// takes care of loading header data
-static void run_animation(FILE *f, unsigned aniId) {
-	TickType_t xLastWakeTime;
-	headerEntry_t myHeader;
+static void player_step(player_t *p) {
+	switch (p->state) {
+	case PL_IDLE:
+		break;
+
+	case PL_PLAY:
+		player_frame(p);
+		if (p->i < p->ani->nFrameEntries)
+			break;
+		player_end(p);
+		player_preload(p);
 
-	if (f == NULL)
-		return;
+		// Keep a single frame displayed for a bit
+		if (p->ani->nStoredFrames <= 3 || p->ani->nFrameEntries <= 3) {
+			p->t_next += 3000 / portTICK_PERIOD_MS;
+			p->state = PL_HOLD;
+		} else {
+			p->state = PL_FADE;
+		}
+		break;
 
-	readHeaderEntry(f, &myHeader, aniId);
-	playAni(f, &myHeader);
-	free(myHeader.frameHeader);
-	myHeader.frameHeader = NULL;
-
-	// Keep a single frame displayed for a bit
-	if (myHeader.nStoredFrames <= 3 || myHeader.nFrameEntries <= 3)
-		vTaskDelay(3000 / portTICK_PERIOD_MS);
-
-	// Fade out the frame
-	uint32_t nTouched = 1;
-	xLastWakeTime = xTaskGetTickCount();
-	while (nTouched) {
-		nTouched = fadeOut(2, 10);
-		vTaskDelayUntil(&xLastWakeTime, g_f_del / portTICK_PERIOD_MS);
+	case PL_HOLD:
+		p->state = PL_FADE;
+		// fall through
+
+	case PL_FADE:
+		// Fade out the frame
+		if (fadeOut(2, 10) == 0)
+			p->state = PL_IDLE;
+		p->t_next += g_f_del / portTICK_PERIOD_MS;
+		break;
 	}
 }
 
+// Opens the index of `f_img` or builds it, if it is missing or belongs to a
+// different animations.img. Returns -1 if there is no usable index.
+static int init_ani_index(FILE *f_img, ani_index_t *idx) {
+	fileHeader_t fh;
+	struct stat st;
+	ani_key_t key;
+
+	if (ani_read_file_header(f_img, &fh) != 0 || stat(ANIMATION_FILE, &st) != 0)
+		return -1;
+	push_print(GREEN, "\n  N: %d  B: %s", fh.nAnimations, fh.buildStr);
+	ani_make_key(&key, &fh, st.st_size, st.st_mtime);
+
+	FILE *f = fopen(ANIMATION_INDEX_FILE, "rb");
+	if (ani_index_open(idx, f, &key) == 0)
+		return 0;
+	if (f)
+		fclose(f);
+
+	// takes a few seconds, once
+	push_print(WHITE, "\nIndexing animations ...");
+	f = fopen(ANIMATION_INDEX_FILE, "wb");
+	if (f == NULL) {
+		ESP_LOGE(
+			T, "fopen(%s, wb) failed: %s", ANIMATION_INDEX_FILE,
+			strerror(errno)
+		);
+		return -1;
+	}
+	int ret = ani_index_build(f_img, f, &key);
+	fclose(f);
+	if (ret < 0)
+		return -1;
+
+	f = fopen(ANIMATION_INDEX_FILE, "rb");
+	if (ani_index_open(idx, f, &key) == 0)
+		return 0;
+	if (f)
+		fclose(f);
+	return -1;
+}
+
+// Opens the compressed ANIMATION_RLE_FILE, or ANIMATION_FILE and its index.
+// Returns the file to read the frames from, or NULL if there are no valid
+// animations.
+static FILE *open_animations(ani_index_t *idx, bool *is_rle) {
+	fileHeader_t fh;
+
+	// the index is read by this task, the frames by the prefetch task
+	FILE *f_idx = fopen(ANIMATION_RLE_FILE, "rb");
+	if (f_idx) {
+		FILE *f = fopen(ANIMATION_RLE_FILE, "rb");
+		if (f && ani_rle_open(idx, f_idx, &fh) == 0 && idx->n > 0) {
+			push_print(
+				GREEN, "\n  N: %d  B: %s (rle)", fh.nAnimations, fh.buildStr
+			);
+			*is_rle = true;
+			return f;
+		}
+		ani_index_free(idx);
+		fclose(f_idx);
+		if (f)
+			fclose(f);
+	}
+
+	*is_rle = false;
+	FILE *f = fopen(ANIMATION_FILE, "r");
+	if (f == NULL) {
+		ESP_LOGE(
+			T, "fopen(%s, rb) failed: %s", ANIMATION_FILE, strerror(errno)
+		);
+		push_print(RED, "\n%s", strerror(errno));
+		return NULL;
+	}
+	if (setvbuf(f, NULL, _IOFBF, 512) != 0)
+		ESP_LOGW(
+			T, " setvbuf(%s, 512) failed: %s", ANIMATION_FILE, strerror(errno)
+		);
+
+	if (init_ani_index(f, idx) != 0 || idx->n == 0) {
+		ESP_LOGE(T, "No valid animations");
+		push_print(RED, "\n  No valid animations");
+		fclose(f);
+		return NULL;
+	}
+	return f;
+}
+
 adc_oneshot_unit_handle_t adc_handle;
 
 void init_light_sensor() {
@@ -300,13 +490,23 @@ static void stats(unsigned cur_fnt) {
 	if (up_time > max_uptime)
 		max_uptime = up_time;
 
+	update_refresh_rate();
+
 	ESP_LOGD(
 		T,
-		"fnt: %d, uptime: %d / %d, fps: %.1f, heap: %ld / %ld, ba: %d, pi: %d",
-		cur_fnt, up_time, max_uptime, fps, esp_get_free_heap_size(),
+		"fnt: %d, uptime: %d / %d, fps: %.1f, refresh: %.0f / %.0f Hz, "
+		"current: %.0f mA, br: %d, ani underruns: %d / %d (%d ms), "
+		"cache hits: %d / %d, heap: %ld / %ld, ba: %d, pi: %d",
+		cur_fnt, up_time, max_uptime, fps, get_refresh_rate(),
+		get_refresh_rate_model(), get_led_current(), get_limited_brightness(),
+		g_prefetch_stats.n_underruns, g_prefetch_stats.n_frames,
+		g_prefetch_stats.max_wait / 1000, g_prefetch_stats.n_hits,
+		g_prefetch_stats.n_hits + g_prefetch_stats.n_misses,
+		esp_get_free_heap_size(),
 		esp_get_minimum_free_heap_size(), uxTaskGetStackHighWaterMark(t_backg),
 		uxTaskGetStackHighWaterMark(t_pinb)
 	);
+	ani_stats_log();
 }
 
 // Returns the number of consecutive `path/0.fnt` files
@@ -351,14 +551,165 @@ static void show_wifi_state() {
 	}
 }
 
+// Sets up the playlist from the `playlist` settings. `weights` maps the
+// header table index of an animation to its weight, 0 disables it.
+static void init_playlist(ani_playlist_t *pl, const ani_index_t *idx) {
+	cJSON *jPl = jGet(getSettings(), "playlist");
+	cJSON *jWeight = NULL;
+
+	if (ani_playlist_init(
+			pl, idx->n, jGetI(jPl, "no_repeat", 10), jGetI(jPl, "weight", 1)
+		) != 0)
+		return;
+
+	cJSON_ArrayForEach(jWeight, jGet(jPl, "weights")) {
+		int headerIndex = atoi(jWeight->string);
+		int i = 0;
+		while (i < idx->n && idx->entries[i].headerIndex != headerIndex)
+			i++;
+		if (i >= idx->n || !cJSON_IsNumber(jWeight)) {
+			ESP_LOGW(T, "playlist: ignoring %s", jWeight->string);
+			continue;
+		}
+		ani_playlist_set_weight(pl, i, jWeight->valueint);
+	}
+}
+
+// the playlist which orders the selection of the flash cache
+static const ani_playlist_t *sel_pl = NULL;
+static const ani_index_t *sel_idx = NULL;
+
+// Higher weights first. Animations of the same weight are spread over the
+// whole collection, the same way on each boot.
+static int cmp_sel(const void *pa, const void *pb) {
+	int a = *(const int *)pa, b = *(const int *)pb;
+	if (sel_pl->weight[a] != sel_pl->weight[b])
+		return sel_pl->weight[b] - sel_pl->weight[a];
+	unsigned ha = sel_idx->entries[a].headerIndex * 2654435761U;
+	unsigned hb = sel_idx->entries[b].headerIndex * 2654435761U;
+	return (ha > hb) - (ha < hb);
+}
+
+// A rewrite of the flash cache, run by flash_task()
+typedef struct {
+	ani_flash_t *fc;
+	ani_index_t idx; // with a file handle of its own
+	FILE *f;
+	bool is_rle;
+	int *sel;
+	int n_sel;
+} flash_job_t;
+
+// set by flash_task() when done, then the player may use the cache again
+static volatile bool is_flash_updated = false;
+
+// Selects the favorites of the `anicache` settings for the flash cache, then
+// the animations with the highest playlist weight, which are played most
+// often. Returns the rewrite of the cache for start_flash_update() if the
+// selection or the animations have changed, NULL otherwise.
+static flash_job_t *plan_flash_update(
+	ani_flash_t *fc, const ani_index_t *idx, bool is_rle,
+	const ani_playlist_t *pl
+) {
+	cJSON *jCache = jGet(getSettings(), "anicache");
+	cJSON *jFav = NULL;
+
+	if (fc->part == NULL || pl->n != idx->n)
+		return NULL;
+
+	int *sel = malloc(idx->n * sizeof(int));
+	uint8_t *is_sel = calloc(idx->n, 1);
+	flash_job_t *job = NULL;
+	if (sel == NULL || is_sel == NULL) {
+		ESP_LOGE(T, "Memory allocation error!");
+		goto done;
+	}
+
+	int n = 0;
+	cJSON_ArrayForEach(jFav, jGet(jCache, "favorites")) {
+		int i = 0;
+		while (i < idx->n && idx->entries[i].headerIndex != jFav->valueint)
+			i++;
+		if (!cJSON_IsNumber(jFav) || i >= idx->n || is_sel[i]) {
+			ESP_LOGW(T, "anicache: ignoring favorite %d", jFav->valueint);
+			continue;
+		}
+		is_sel[i] = 1;
+		sel[n++] = i;
+	}
+	const int n_fav = n;
+	for (int i = 0; i < idx->n; i++)
+		if (!is_sel[i] && pl->weight[i] > 0)
+			sel[n++] = i;
+	sel_pl = pl;
+	sel_idx = idx;
+	qsort(&sel[n_fav], n - n_fav, sizeof(int), cmp_sel);
+
+	if (ani_flash_key(idx, is_rle, sel, n) == fc->key)
+		goto done;
+	job = malloc(sizeof(flash_job_t));
+	if (job == NULL) {
+		ESP_LOGE(T, "Memory allocation error!");
+		goto done;
+	}
+	*job = (flash_job_t){
+		.fc = fc, .idx = *idx, .is_rle = is_rle, .sel = sel, .n_sel = n
+	};
+	sel = NULL;
+
+done:
+	free(sel);
+	free(is_sel);
+	return job;
+}
+
+static void flash_task(void *pvParameters) {
+	flash_job_t *job = pvParameters;
+	ESP_LOGI(T, "caching animations ...");
+	if (ani_flash_update(
+			job->fc, &job->idx, job->f, job->is_rle, job->sel, job->n_sel
+		) != 0)
+		ESP_LOGE(T, "caching animations failed");
+	ESP_LOGI(T, "cached: %d", job->fc->idx.n);
+
+	fclose(job->idx.f);
+	fclose(job->f);
+	free(job->sel);
+	free(job);
+	is_flash_updated = true;
+	vTaskDelete(NULL);
+}
+
+// Rewrites the flash cache in the background, which takes a while. The SD
+// card is read through file handles of its own, as the player keeps reading
+// it. The cache must not be used until is_flash_updated is set.
+static void start_flash_update(flash_job_t *job) {
+	job->idx.f = fopen(
+		job->is_rle ? ANIMATION_RLE_FILE : ANIMATION_INDEX_FILE, "rb"
+	);
+	job->f = fopen(job->is_rle ? ANIMATION_RLE_FILE : ANIMATION_FILE, "rb");
+	if (job->idx.f == NULL || job->f == NULL ||
+		xTaskCreatePinnedToCore(
+			&flash_task, "ani_fc", 1024 * 4, job, 0, NULL, 0
+		) != pdPASS) {
+		ESP_LOGE(T, "can't start caching animations");
+		if (job->idx.f)
+			fclose(job->idx.f);
+		if (job->f)
+			fclose(job->f);
+		free(job->sel);
+		free(job);
+		// the old cache has not been touched
+		is_flash_updated = true;
+	}
+}
+
 // takes care of drawing pinball animations (layer 2) and the clock (layer 1)
 void aniPinballTask(void *pvParameters) {
 	unsigned cycles = 0;
 	static int sec_ = 0;
 	static int wifi_state_last = -1;
 
-	TickType_t xLastWakeTime = xTaskGetTickCount();
-
 	// init built in font
 	setAll(1, 0x00000000);
 	initFont("/spiffs/lemon.fnt");
@@ -383,26 +734,48 @@ void aniPinballTask(void *pvParameters) {
 	// Open animation file on SD card
 	//------------------------------
 	push_print(WHITE, "\nLoading animations ...");
-	fileHeader_t fh;
-	FILE *fAnimations = fopen(ANIMATION_FILE, "r");
-	if (fAnimations == NULL) {
-		ESP_LOGE(
-			T, "fopen(%s, rb) failed: %s", ANIMATION_FILE, strerror(errno)
-		);
+	cJSON *jAni = jGet(getSettings(), "animations");
+	ani_index_t aniIndex = {0};
+	ani_playlist_t playlist = {0};
+	static ani_flash_t aniFlash;
+	// the cache is rewritten once the first animation plays
+	flash_job_t *flash_job = NULL;
+	bool is_rle = false;
+	FILE *fAnimations = open_animations(&aniIndex, &is_rle);
+	ani_flash_open(&aniFlash);
+	const ani_index_t *idx = &aniIndex;
+	if (fAnimations == NULL && aniFlash.idx.n == 0) {
 		ESP_LOGE(T, "Will not show animations!");
-		push_print(RED, "\n%s", strerror(errno));
 		vTaskDelay(5000 / portTICK_PERIOD_MS);
 	} else {
-		if (setvbuf(fAnimations, NULL, _IOFBF, 512) != 0)
-			ESP_LOGW(
-				T, " setvbuf(%s, 512) failed: %s", ANIMATION_FILE,
-				strerror(errno)
+		const char *path = is_rle ? ANIMATION_RLE_FILE : ANIMATION_FILE;
+		if (fAnimations) {
+			push_print(GREEN, "  valid: %d", aniIndex.n);
+		} else {
+			// without SD card, the cached animations are shown
+			push_print(GREEN, "\n  cached: %d", aniFlash.idx.n);
+			idx = &aniFlash.idx;
+			path = NULL;
+		}
+		// number of frames read ahead and RAM for repeated frames
+		ani_prefetch_init(
+			jGetI(jAni, "prefetch", 4), jGetI(jAni, "cache_kb", 16) * 1024,
+			is_rle, jGetB(jAni, "direct_read", true) ? path : NULL
+		);
+		init_playlist(&playlist, idx);
+		if (fAnimations)
+			flash_job = plan_flash_update(
+				&aniFlash, &aniIndex, is_rle, &playlist
 			);
-
-		getFileHeader(fAnimations, &fh);
-		push_print(GREEN, "\n  N: %d  B: %s", fh.nAnimations, fh.buildStr);
+		if (flash_job)
+			push_print(WHITE, "\n  caching after the start");
+		else
+			push_print(GREEN, "\n  cached: %d", aniFlash.idx.n);
 		vTaskDelay(1000 / portTICK_PERIOD_MS);
 	}
+	player_init(&player, fAnimations, idx, &playlist, &aniFlash);
+	if (flash_job == NULL)
+		player_use_cache(&player);
 
 	show_wifi_state();
 	wifi_state_last = wifi_state;
@@ -451,29 +824,56 @@ void aniPinballTask(void *pvParameters) {
 
 	unsigned cur_fnt = 0;
 
+	// seconds since the last animation ended
+	unsigned ani_wait = 0;
+
+	// a WiFi message is shown instead of the clock until t_msg
+	bool is_msg = false;
+	TickType_t t_msg = 0;
+
+	// The loop runs once per animation frame and at least once per second.
+	// `cycles` counts the seconds.
+	TickType_t t_cycle = xTaskGetTickCount();
 	while (1) {
 		bool doRedrawFont = false;
 
-		// draw an animation
-		if (fAnimations && cycles > 0 && cycles % ani_delay == 0) {
-			unsigned aniId = RAND_AB(0, fh.nAnimations - 1);
-			// aniId = 0x0619;
-			run_animation(fAnimations, aniId);
-		}
+		// advance the animation
+		TickType_t t_now = xTaskGetTickCount();
+		if (player.state != PL_IDLE && (int32_t)(t_now - player.t_next) >= 0)
+			player_step(&player);
+
+		bool is_cycle = (int32_t)(t_now - t_cycle) >= 0;
+		if (is_cycle) {
+			t_cycle += 1000 / portTICK_PERIOD_MS;
+
+			// start an animation, delays.ani seconds after the last one
+			if (player.state == PL_IDLE && ani_wait++ >= ani_delay) {
+				ani_wait = 0;
+				player_start(&player);
+				if (flash_job) {
+					start_flash_update(flash_job);
+					flash_job = NULL;
+				}
+			}
+			if (is_flash_updated) {
+				is_flash_updated = false;
+				player_use_cache(&player);
+			}
 
-		// change font color every delays.color minutes
-		if (cycles % color_delay == 0) {
-			color = 0xFF000000 | rand();
-			doRedrawFont = true;
-		}
+			// change font color every delays.color seconds
+			if (cycles % color_delay == 0) {
+				color = 0xFF000000 | rand();
+				doRedrawFont = true;
+			}
 
-		// change font every delays.font minutes
-		if (nFnts > 0 && cycles % font_delay == 0) {
-			cur_fnt = RAND_AB(0, nFnts - 1);
-			sprintf(strftime_buf, "/sd/fnt/%03d.fnt", cur_fnt);
-			// cur_fnt = (cur_fnt + 1) % nFnts;
-			initFont(strftime_buf);
-			doRedrawFont = true;
+			// change font every delays.font seconds
+			if (nFnts > 0 && cycles % font_delay == 0) {
+				cur_fnt = RAND_AB(0, nFnts - 1);
+				sprintf(strftime_buf, "/sd/fnt/%03d.fnt", cur_fnt);
+				// cur_fnt = (cur_fnt + 1) % nFnts;
+				initFont(strftime_buf);
+				doRedrawFont = true;
+			}
 		}
 
 		// get the wall-clock time
@@ -481,11 +881,21 @@ void aniPinballTask(void *pvParameters) {
 		time(&now);
 		localtime_r(&now, &timeinfo);
 
+		// the clock comes back after the message
+		if (is_msg && (int32_t)(t_now - t_msg) >= 0) {
+			is_msg = false;
+			doRedrawFont = true;
+		}
+
 		// Redraw the clock when tm_sec rolls over
 		if (doRedrawFont || sec_ > timeinfo.tm_sec) {
-			strftime(strftime_buf, sizeof(strftime_buf), "%H:%M", &timeinfo);
-			// randomly colored outline, black filling
-			drawStrCentered(strftime_buf, color, 0xFF000000);
+			if (!is_msg) {
+				strftime(
+					strftime_buf, sizeof(strftime_buf), "%H:%M", &timeinfo
+				);
+				// randomly colored outline, black filling
+				drawStrCentered(strftime_buf, color, 0xFF000000);
+			}
 
 			manageBrightness(&timeinfo);
 			stats(cur_fnt);
@@ -522,13 +932,27 @@ void aniPinballTask(void *pvParameters) {
 				init_print();
 				show_wifi_state();
 				restore_print();
-				vTaskDelay(2000 / portTICK_PERIOD_MS);
+				is_msg = true;
+				t_msg = xTaskGetTickCount() + 2000 / portTICK_PERIOD_MS;
 			}
 			wifi_state_last = wifi_state;
 		}
 
-		cycles++;
-		vTaskDelayUntil(&xLastWakeTime, 1000 / portTICK_PERIOD_MS);
+		if (is_cycle)
+			cycles++;
+
+		// sleep until the next animation step or second, or for a tick while
+		// waiting for a frame
+		TickType_t t_wake = t_cycle;
+		if (player.state != PL_IDLE && (int32_t)(player.t_next - t_wake) < 0)
+			t_wake = player.t_next;
+		if (is_msg && (int32_t)(t_msg - t_wake) < 0)
+			t_wake = t_msg;
+		int32_t dt = t_wake - xTaskGetTickCount();
+		if (dt > 0)
+			vTaskDelay(dt);
+		else if (player.state == PL_PLAY && player.is_waiting)
+			vTaskDelay(1);
 	}
 
 	if (fAnimations)
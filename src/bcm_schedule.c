@@ -0,0 +1,65 @@
+// Binary code modulation schedule, hardware independent so it can be
+// modeled on the host (dev/panel_sim)
+
+#include "bcm_schedule.h"
+
+void bcm_schedule_init(bcm_schedule_t *s, int n_planes, int n_lsb) {
+	if (n_planes > BCM_MAX_PLANES)
+		n_planes = BCM_MAX_PLANES;
+	if (n_lsb > n_planes - 1)
+		n_lsb = n_planes - 1;
+	if (n_lsb < 0)
+		n_lsb = 0;
+
+	s->n_planes = n_planes;
+	s->n_lsb = n_lsb;
+	s->len = 0;
+
+	// The lowest n_lsb planes are shown once, the ones above are repeated
+	for (int pl = 0; pl < n_planes; pl++) {
+		s->reps[pl] = (pl < n_lsb) ? 1 : (1 << (pl - n_lsb));
+		s->len += s->reps[pl];
+	}
+
+	// Do binary time division setup. Essentially, we need n of plane 0, 2n of
+	// plane 1, 4n of plane 2 etc, but that needs to be divided evenly over time
+	// to stop flicker from happening. This little bit of code tries to do that
+	// more-or-less elegantly.
+	int times[BCM_MAX_PLANES] = {0};
+	for (int i = 0; i < s->len; i++) {
+		int ch = 0;
+
+		// Find plane that needs insertion the most
+		for (int j = 0; j < n_planes; j++) {
+			if (times[j] <= times[ch])
+				ch = j;
+		}
+
+		// Insert the plane
+		s->slots[i] = ch;
+
+		// Magic to make sure we choose this bitplane an appropriate time later
+		// next time
+		times[ch] += (1 << n_planes) / s->reps[ch];
+	}
+}
+
+int bcm_oe_width(const bcm_schedule_t *s, int pl, int br) {
+	if (pl >= s->n_lsb)
+		return br;
+	// 2^(pl - n_lsb) of the full window, rounded
+	int sh = s->n_lsb - pl;
+	return (br + (1 << (sh - 1))) >> sh;
+}
+
+int bcm_weight(const bcm_schedule_t *s, int pl, int br) {
+	return s->reps[pl] * bcm_oe_width(s, pl, br);
+}
+
+float bcm_refresh_rate(const bcm_schedule_t *s, int clk_div, int scan_words) {
+	if (clk_div < 2)
+		clk_div = 2;
+	// 80 MHz / clkm_div_num / tx_bck_div_num (2)
+	float f_pixel = 80e6 / clk_div / 2;
+	return f_pixel / scan_words / s->len;
+}
@@ -0,0 +1,37 @@
+#ifndef BCM_SCHEDULE_H
+#define BCM_SCHEDULE_H
+#include <stdint.h>
+
+// Binary code modulation (BCM) schedule for the bitplanes.
+//
+// Bitplane `pl` must be shown with a weight of 2^pl. The upper planes get
+// there by being repeated in the DMA descriptor chain, the lowest `n_lsb`
+// planes are shown only once, with a proportionally shorter output enable
+// window. n_lsb = 0 is plain binary time division with 2^n - 1 slots.
+
+#define BCM_MAX_PLANES 8
+
+typedef struct {
+	int n_planes; // number of bitplanes
+	int n_lsb;	  // number of planes shown once with a shortened OE window
+	int len;	  // number of used entries in `slots`
+	uint8_t slots[(1 << BCM_MAX_PLANES) - 1]; // bitplane index per time slot
+	uint8_t reps[BCM_MAX_PLANES];			  // how often a plane is in `slots`
+} bcm_schedule_t;
+
+// Distribute the repetitions of the bitplanes evenly over time
+void bcm_schedule_init(bcm_schedule_t *s, int n_planes, int n_lsb);
+
+// Width of the output enable window [columns] of bitplane `pl` for a global
+// brightness of `br` columns
+int bcm_oe_width(const bcm_schedule_t *s, int pl, int br);
+
+// Effective on-time of bitplane `pl` per refresh [columns], for a global
+// brightness of `br` columns. Ideally proportional to 2^pl.
+int bcm_weight(const bcm_schedule_t *s, int pl, int br);
+
+// Panel refresh rate [Hz] for a I2S clock divider of `clk_div` and
+// `scan_words` DMA words per bitplane
+float bcm_refresh_rate(const bcm_schedule_t *s, int clk_div, int scan_words);
+
+#endif
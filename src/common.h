@@ -71,13 +71,31 @@ extern TaskHandle_t t_pinb;
 #define RAND_AB(a, b) (rand() % (b + 1 - a) + a)
 #endif
 
-// Width and height of the chain of panels [pixels]
-// ... don't change it, things will catch fire! :p
-#define DISPLAY_WIDTH 128
-#define DISPLAY_HEIGHT 32
+// Width and height of the framebuffer [pixels]
+// The panels, their scan pattern and how they are chained are described
+// in the `layout` section of settings.json and must cover exactly this area.
+// Both must be powers of 2. Other sizes than 128 x 32 are set with build
+// flags, see platformio.ini.
+#ifndef DISPLAY_WIDTH
+	#define DISPLAY_WIDTH 128
+#endif
+#ifndef DISPLAY_HEIGHT
+	#define DISPLAY_HEIGHT 32
+#endif
 
 #define ANIMATION_FILE "/sd/animations.img"
 
+// list of the valid animations and their frame tables, built at boot if
+// missing or outdated, see ani_file.h
+#define ANIMATION_INDEX_FILE "/sd/animations.idx"
+
+// compressed animations, see ani_rle.h. Used instead of ANIMATION_FILE if
+// it exists
+#define ANIMATION_RLE_FILE "/sd/animations.rle"
+
+// optional per channel intensity tables, see dev/calibration_lut.py
+#define CALIBRATION_FILE "/sd/calibration.bin"
+
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 
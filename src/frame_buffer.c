@@ -3,7 +3,6 @@
 #include "frame_buffer.h"
 #include "fast_hsv2rgb.h"
 #include "rgb_led_panel.h"
-#include "val2pwm.h"
 #include <math.h>
 #include <stdio.h>
 #include <stdbool.h>
@@ -19,13 +18,11 @@
 #include "json_settings.h"
 
 SemaphoreHandle_t fbSemaphore = NULL;
+static bool is_locked = false;
 #endif
 
 static const char *T = "FRAME_BUFFER";
 
-static bool is_gamma = false;
-static bool is_locked = false;
-
 // framebuffer with `N_LAYERS` in MSB ABGR LSB format
 // Colors are premultiplied with their alpha values for easiser compositing
 unsigned g_frameBuff[N_LAYERS][DISPLAY_WIDTH * DISPLAY_HEIGHT];
@@ -46,7 +43,6 @@ void initFb() {
 		setAll(i, 0);
 
 	cJSON *jPanel = jGet(getSettings(), "panel");
-	is_gamma = jGetB(jPanel, "is_gamma", true);
 	is_locked = jGetB(jPanel, "is_locked", true);
 
 	xSemaphoreGive(fbSemaphore);
@@ -57,21 +53,15 @@ void initFb() {
 //  assuming the image is a DISPLAY_WIDTHx32 8A8R8G8B image. Color values are
 //  premultipleid with alpha Returns it as an uint32 with the lower 24 bits
 //  containing the RGB values.
-unsigned getBlendedPixel(unsigned x, unsigned y) {
+unsigned getBlendedPixelRawIdx(unsigned i) {
 	unsigned resR = 0, resG = 0, resB = 0;
 	for (unsigned l = 0; l < N_LAYERS; l++) {
 		// Get a pixel value of one layer
-		unsigned p = g_frameBuff[l][x + y * DISPLAY_WIDTH];
+		unsigned p = g_frameBuff[l][i];
 		resR = INT_PRELERP(resR, GR(p), GA(p));
 		resG = INT_PRELERP(resG, GG(p), GA(p));
 		resB = INT_PRELERP(resB, GB(p), GA(p));
 	}
-	// not sure if worth it ...
-	if (is_gamma) {
-		resR = valToPwm(resR);
-		resG = valToPwm(resG);
-		resB = valToPwm(resB);
-	}
 	return (resB << 16) | (resG << 8) | resR;
 }
 
@@ -197,6 +187,11 @@ void set_shade_transparent(unsigned color, unsigned *shades) {
 		shades[i] = scale32(i * 17, color);
 }
 
+// the 2 RGBA pixels of each byte of a pinball animation frame, for one color
+static unsigned pair_lut[256][2];
+static unsigned pair_lut_color;
+static bool is_pair_lut = false;
+
 // takes a 4 bit shade from pinball animation, returns the 32 bit RGBA pixel
 static unsigned get_pix_color(unsigned pix, unsigned *shades) {
 	pix &= 0x0F;
@@ -205,23 +200,106 @@ static unsigned get_pix_color(unsigned pix, unsigned *shades) {
 	return shades[pix];
 }
 
+void set_shade_pairs(unsigned color, unsigned pairs[256][2]) {
+	unsigned shades[N_SHADES];
+	set_shade_opaque(color, shades);
+	for (unsigned i = 0; i < 256; i++) {
+		pairs[i][0] = get_pix_color(i >> 4, shades);
+		pairs[i][1] = get_pix_color(i, shades);
+	}
+}
+
+// the color only changes between animations
+static void update_pair_lut(unsigned color) {
+	if (!is_pair_lut || color != pair_lut_color) {
+		set_shade_pairs(color, pair_lut);
+		pair_lut_color = color;
+		is_pair_lut = true;
+	}
+}
+
 void setFromFile(FILE *f, unsigned layer, unsigned color) {
-	uint8_t frm_buff[DISPLAY_WIDTH * DISPLAY_HEIGHT / 2], *pix = frm_buff;
-	unsigned *p = g_frameBuff[layer];
+	uint8_t frm_buff[DISPLAY_WIDTH * DISPLAY_HEIGHT / 2];
 	unsigned ret = fread(frm_buff, 1, sizeof(frm_buff), f);
 	if (ret != sizeof(frm_buff)) {
 		ESP_LOGE(T, "fread error: %d vs %d", ret, sizeof(frm_buff));
 		return;
 	}
+	setFromBuf(frm_buff, layer, color);
+}
 
-	unsigned shades[N_SHADES];
-	set_shade_opaque(color, shades);
+void setFromBuf(const uint8_t *frm_buff, unsigned layer, unsigned color) {
+	const uint8_t *pix = frm_buff;
+	unsigned *p = g_frameBuff[layer];
+
+	update_pair_lut(color);
+
+	// one table lookup per 2 pixels, 4 bytes per iteration
+	for (int i = 0; i < DISPLAY_WIDTH * DISPLAY_HEIGHT / 2; i += 4) {
+		const unsigned *a = pair_lut[pix[0]], *b = pair_lut[pix[1]];
+		const unsigned *c = pair_lut[pix[2]], *d = pair_lut[pix[3]];
+		p[0] = a[0];
+		p[1] = a[1];
+		p[2] = b[0];
+		p[3] = b[1];
+		p[4] = c[0];
+		p[5] = c[1];
+		p[6] = d[0];
+		p[7] = d[1];
+		pix += 4;
+		p += 8;
+	}
+}
+
+void set_frame_place(
+	frame_place_t *pl, int w, int h, int scale, const char *anchor
+) {
+	int max_scale = MIN(DISPLAY_WIDTH / w, DISPLAY_HEIGHT / h);
+	if (scale <= 0 || scale > max_scale)
+		scale = max_scale;
+	if (scale < 1)
+		scale = 1;
+	pl->w = w;
+	pl->h = h;
+	pl->scale = scale;
+
+	int dx = DISPLAY_WIDTH - w * scale, dy = DISPLAY_HEIGHT - h * scale;
+	pl->x0 = strstr(anchor, "left") ? 0 : strstr(anchor, "right") ? dx : dx / 2;
+	pl->y0 = strstr(anchor, "top") ? 0 : strstr(anchor, "bottom") ? dy : dy / 2;
+}
 
-	for (int i = 0; i < DISPLAY_WIDTH * DISPLAY_HEIGHT / 2; i++) {
-		// unpack the 2 pixels per byte, put their shades in the framebuffer
-		*p++ = get_pix_color(*pix >> 4, shades);
-		*p++ = get_pix_color(*pix, shades);
-		pix++;
+void setFromBufPlaced(
+	const uint8_t *frm_buff, unsigned layer, unsigned color,
+	const frame_place_t *pl
+) {
+	const int s = pl->scale;
+	const uint8_t *pix = frm_buff;
+	unsigned *fb = g_frameBuff[layer];
+
+	if (pl->w == DISPLAY_WIDTH && pl->h == DISPLAY_HEIGHT && s == 1) {
+		setFromBuf(frm_buff, layer, color);
+		return;
+	}
+	if (pl->w * s > DISPLAY_WIDTH || pl->h * s > DISPLAY_HEIGHT)
+		return;
+
+	update_pair_lut(color);
+	setAll(layer, 0xFF000000);
+
+	// scale x scale pixels per input pixel, in a single pass
+	for (int y = 0; y < pl->h; y++) {
+		unsigned *row = &fb[(pl->y0 + y * s) * DISPLAY_WIDTH + pl->x0];
+		unsigned *p = row;
+		for (int x = 0; x < pl->w / 2; x++) {
+			const unsigned *c = pair_lut[*pix++];
+			for (int i = 0; i < s; i++)
+				*p++ = c[0];
+			for (int i = 0; i < s; i++)
+				*p++ = c[1];
+		}
+		// the other rows of the pixels are the same
+		for (int i = 1; i < s; i++)
+			memcpy(&row[i * DISPLAY_WIDTH], row, pl->w * s * sizeof(unsigned));
 	}
 }
 
@@ -50,7 +50,9 @@ static inline unsigned scale32(unsigned scale, unsigned p) {
 
 extern unsigned g_frameBuff[N_LAYERS][DISPLAY_WIDTH * DISPLAY_HEIGHT];
 
-unsigned getBlendedPixel(unsigned x, unsigned y);
+// the pixel at index x + y * DISPLAY_WIDTH, blended over all layers, without
+// gamma correction. The panel encoder applies that (panel_encoder.h)
+unsigned getBlendedPixelRawIdx(unsigned i);
 
 // SET / GET a single pixel on a layer to a specific RGBA color in the
 // framebuffer
@@ -63,6 +65,10 @@ unsigned getPixel(unsigned layer, unsigned x, unsigned y);
 // pre-calculate a palette of 16 shades fading up from opaque black
 void set_shade_opaque(unsigned color, unsigned *shades);
 
+// pre-calculate the 2 pixels of each byte of a pinball animation frame, with
+// the shades of set_shade_opaque(). Shade 0x0A is transparent
+void set_shade_pairs(unsigned color, unsigned pairs[256][2]);
+
 // pre-calculate a palette of 16 shades fading up from transparent
 void set_shade_transparent(unsigned color, unsigned *shades);
 
@@ -90,6 +96,31 @@ void setAll(unsigned layer, unsigned color);
 // write image from a runDmd image file into layer with shades of color
 void setFromFile(FILE *f, unsigned layer, unsigned color);
 
+// same for a frame already in RAM, 2 pixels per byte
+void setFromBuf(const uint8_t *frm_buff, unsigned layer, unsigned color);
+
+// Where a pinball animation frame of w x h pixels is shown, each pixel
+// scale x scale in size. See set_frame_place()
+typedef struct {
+	int w, h;
+	int x0, y0; // top left corner [pixels]
+	int scale;
+} frame_place_t;
+
+// Calculates the largest placement of a w x h frame which fits on the
+// display. `scale` is the requested factor, 0 = as large as possible.
+// `anchor` is "center" or contains "left" / "right" and "top" / "bottom".
+void set_frame_place(
+	frame_place_t *pl, int w, int h, int scale, const char *anchor
+);
+
+// same as setFromBuf(), for a w x h frame at a placement. The rest of the
+// layer is black
+void setFromBufPlaced(
+	const uint8_t *frm_buff, unsigned layer, unsigned color,
+	const frame_place_t *pl
+);
+
 // make the layer a little more transparent each call.
 // Factor=255 is strongest. Returns the number of pixels changed.
 unsigned fadeOut(unsigned layer, unsigned factor);
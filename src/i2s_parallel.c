@@ -15,6 +15,7 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "freertos/FreeRTOS.h"
@@ -30,7 +31,9 @@
 #include "driver/gpio.h"
 #include "esp_private/periph_ctrl.h"
 
+#include "esp_attr.h"
 #include "esp_heap_caps.h"
+#include "esp_intr_alloc.h"
 #include "esp_log.h"
 #include "rom/gpio.h"
 #include "rom/lldesc.h"
@@ -42,10 +45,23 @@ static const char *T = "I2S_P";
 typedef struct {
 	volatile lldesc_t *dmadesc_a, *dmadesc_b;
 	int desccount_a, desccount_b;
+	intr_handle_t intr;
+	// optional callback after each buffer of bufa, see i2s_parallel_config_t
+	void (*on_eof)(int buf_idx, void *arg);
+	void *on_eof_arg;
+	// index into bufa of each DMA descriptor, only used with on_eof
+	uint16_t *desc_buf;
+	// routed pins, released again by i2s_parallel_teardown()
+	gpio_num_t gpio[25];
+	int n_gpio;
 } i2s_parallel_state_t;
 
 static i2s_parallel_state_t *i2s_state[2] = {NULL, NULL};
 
+// incremented by the EOF interrupt of the last descriptor in the chain. Kept
+// out of i2s_state, so it can be read while the state is torn down.
+static volatile unsigned loop_count[2] = {0, 0};
+
 #define DMA_MAX (4096 - 4)
 
 // Calculate the amount of dma descs needed for a buffer desc
@@ -57,8 +73,12 @@ static int calc_needed_dma_descs_for(i2s_parallel_buffer_desc_t *desc) {
 	return ret;
 }
 
-static void
-fill_dma_desc(volatile lldesc_t *dmadesc, i2s_parallel_buffer_desc_t *bufdesc) {
+// With `desc_buf` != NULL, every buffer raises an EOF interrupt and the
+// buffer index of each descriptor is stored in `desc_buf`
+static void fill_dma_desc(
+	volatile lldesc_t *dmadesc, i2s_parallel_buffer_desc_t *bufdesc,
+	uint16_t *desc_buf
+) {
 	int n = 0;
 	for (int i = 0; bufdesc[i].memory != NULL; i++) {
 		int len = bufdesc[i].size;
@@ -77,11 +97,31 @@ fill_dma_desc(volatile lldesc_t *dmadesc, i2s_parallel_buffer_desc_t *bufdesc) {
 			dmadesc[n].offset = 0;
 			len -= dmalen;
 			data += dmalen;
+			if (desc_buf) {
+				desc_buf[n] = i;
+				dmadesc[n].eof = len == 0;
+			}
 			n++;
 		}
 	}
-	// Loop last back to first
+	// Loop last back to first, raise an EOF interrupt after each loop
 	dmadesc[n - 1].qe.stqe_next = (lldesc_t *)&dmadesc[0];
+	dmadesc[n - 1].eof = 1;
+}
+
+// Counts the trips through the descriptor chain and calls on_eof
+static void IRAM_ATTR i2s_isr(void *arg) {
+	i2s_dev_t *dev = (i2s_dev_t *)arg;
+	int no = (dev == &I2S0) ? 0 : 1;
+	i2s_parallel_state_t *st = i2s_state[no];
+	if (dev->int_st.out_eof && st) {
+		int n = (lldesc_t *)dev->out_eof_des_addr - st->dmadesc_a;
+		if (n == st->desccount_a - 1)
+			loop_count[no]++;
+		if (st->on_eof && n >= 0 && n < st->desccount_a)
+			st->on_eof(st->desc_buf[n], st->on_eof_arg);
+	}
+	dev->int_clr.val = dev->int_st.val;
 }
 
 static void gpio_setup_out(gpio_num_t gpio, int sig, bool isInverted) {
@@ -116,19 +156,26 @@ static void fifo_reset(i2s_dev_t *dev) {
 static int i2snum(i2s_dev_t *dev) { return (dev == &I2S0) ? 0 : 1; }
 
 void i2s_parallel_setup(i2s_dev_t *dev, const i2s_parallel_config_t *cfg) {
-	// Figure out which signal numbers to use for routing
+	// Figure out which signal numbers to use for routing. In LCD mode both
+	// peripherals put the samples on the upper lines of the 24 bit bus: the
+	// 16-bit values appear on d8...d23 and the 8-bit values on d16...d23,
+	// the same lanes as the esp_lcd i80 driver of ESP-IDF uses
 	int sig_data_base, sig_clk;
 	if (dev == &I2S0) {
-		sig_data_base = I2S0O_DATA_OUT0_IDX;
+		if (cfg->bits == I2S_PARALLEL_BITS_32)
+			sig_data_base = I2S0O_DATA_OUT0_IDX;
+		else if (cfg->bits == I2S_PARALLEL_BITS_16)
+			sig_data_base = I2S0O_DATA_OUT8_IDX;
+		else
+			sig_data_base = I2S0O_DATA_OUT16_IDX;
 		sig_clk = I2S0O_WS_OUT_IDX;
 	} else {
-		if (cfg->bits == I2S_PARALLEL_BITS_32) {
+		if (cfg->bits == I2S_PARALLEL_BITS_32)
 			sig_data_base = I2S1O_DATA_OUT0_IDX;
-		} else {
-			// Because of... reasons... the 16-bit values for i2s1 appear on
-			// d8...d23
+		else if (cfg->bits == I2S_PARALLEL_BITS_16)
 			sig_data_base = I2S1O_DATA_OUT8_IDX;
-		}
+		else
+			sig_data_base = I2S1O_DATA_OUT16_IDX;
 		sig_clk = I2S1O_WS_OUT_IDX;
 	}
 
@@ -190,7 +237,11 @@ void i2s_parallel_setup(i2s_dev_t *dev, const i2s_parallel_config_t *cfg) {
 	dev->fifo_conf.dscr_en = 1;
 	// Mode 1, single 16-bit channel, load 16 bit sample(*) into fifo and pad to
 	// 32 bit with zeros *Actually a 32 bit read where two samples are read at
-	// once. Length of fifo must thus still be word-aligned
+	// once. Length of fifo must thus still be word-aligned. The upper half of
+	// the word goes out first (ESP32_TX_FIFO_POSITION_ADJUST).
+	// 8-bit samples use the same mode, with tx_bits_mod = 8 a 16 bit FIFO
+	// entry holds two of them, low byte first, which gives the byte order
+	// of ESP32_TX_FIFO_POSITION_ADJUST8
 	dev->fifo_conf.tx_fifo_mod = 1;
 
 	dev->fifo_conf.rx_fifo_mod_force_en = 1;
@@ -200,7 +251,7 @@ void i2s_parallel_setup(i2s_dev_t *dev, const i2s_parallel_config_t *cfg) {
 	dev->conf1.tx_stop_en = 0;
 	dev->conf1.tx_pcm_bypass = 1;
 
-	// 16-bit single channel data
+	// single channel data, for all sample widths
 	dev->conf_chan.val = 0;
 	dev->conf_chan.tx_chan_mod = 1;
 	dev->conf_chan.rx_chan_mod = 1;
@@ -226,20 +277,30 @@ void i2s_parallel_setup(i2s_dev_t *dev, const i2s_parallel_config_t *cfg) {
 	i2s_state[i2snum(dev)] =
 		(i2s_parallel_state_t *)malloc(sizeof(i2s_parallel_state_t));
 	i2s_parallel_state_t *st = i2s_state[i2snum(dev)];
+	st->n_gpio = 0;
+	for (int x = 0; x < cfg->bits; x++)
+		st->gpio[st->n_gpio++] = cfg->gpio_bus[x];
+	st->gpio[st->n_gpio++] = cfg->gpio_clk;
+	st->on_eof = cfg->on_eof;
+	st->on_eof_arg = cfg->on_eof_arg;
 	st->desccount_a = calc_needed_dma_descs_for(cfg->bufa);
 	st->dmadesc_a = (volatile lldesc_t *)heap_caps_malloc(
 		st->desccount_a * sizeof(lldesc_t), MALLOC_CAP_DMA
 	);
+	st->desc_buf = NULL;
+	if (st->on_eof)
+		st->desc_buf = malloc(st->desccount_a * sizeof(uint16_t));
 	// and fill them
-	fill_dma_desc(st->dmadesc_a, cfg->bufa);
+	fill_dma_desc(st->dmadesc_a, cfg->bufa, st->desc_buf);
 
 	if (cfg->bufb) {
 		st->desccount_b = calc_needed_dma_descs_for(cfg->bufb);
 		st->dmadesc_b = (volatile lldesc_t *)heap_caps_malloc(
 			st->desccount_b * sizeof(lldesc_t), MALLOC_CAP_DMA
 		);
-		fill_dma_desc(st->dmadesc_b, cfg->bufb);
+		fill_dma_desc(st->dmadesc_b, cfg->bufb, NULL);
 	} else {
+		st->dmadesc_b = NULL;
 		st->desccount_b = 0;
 	}
 
@@ -259,6 +320,15 @@ void i2s_parallel_setup(i2s_dev_t *dev, const i2s_parallel_config_t *cfg) {
 	dev->conf.tx_fifo_reset = 0;
 	dev->conf.rx_fifo_reset = 0;
 
+	// Count the EOF interrupts to measure the refresh rate
+	dev->int_ena.val = 0;
+	dev->int_clr.val = 0xFFFFFFFF;
+	dev->int_ena.out_eof = 1;
+	esp_intr_alloc(
+		(dev == &I2S0) ? ETS_I2S0_INTR_SOURCE : ETS_I2S1_INTR_SOURCE,
+		ESP_INTR_FLAG_IRAM, i2s_isr, (void *)dev, &st->intr
+	);
+
 	// Start dma on front buffer
 	dev->lc_conf.val =
 		I2S_OUT_DATA_BURST_EN | I2S_OUTDSCR_BURST_EN | I2S_OUT_DATA_BURST_EN;
@@ -267,6 +337,45 @@ void i2s_parallel_setup(i2s_dev_t *dev, const i2s_parallel_config_t *cfg) {
 	dev->conf.tx_start = 1;
 }
 
+void i2s_parallel_teardown(i2s_dev_t *dev) {
+	int no = i2snum(dev);
+	i2s_parallel_state_t *st = i2s_state[no];
+	if (st == NULL)
+		return;
+
+	// Stop the DMA and the interrupt before freeing what they read
+	dev->conf.tx_start = 0;
+	dev->out_link.stop = 1;
+	dev->int_ena.val = 0;
+	dev->int_clr.val = 0xFFFFFFFF;
+	esp_intr_free(st->intr);
+	i2s_state[no] = NULL;
+
+	fifo_reset(dev);
+	dma_reset(dev);
+
+	// The next setup may route different pins
+	for (int i = 0; i < st->n_gpio; i++)
+		if (st->gpio[i] != -1)
+			gpio_reset_pin(st->gpio[i]);
+
+	heap_caps_free((void *)st->dmadesc_a);
+	if (st->dmadesc_b)
+		heap_caps_free((void *)st->dmadesc_b);
+	free(st->desc_buf);
+	free(st);
+
+	if (dev == &I2S0) {
+		periph_module_disable(PERIPH_I2S0_MODULE);
+	} else {
+		periph_module_disable(PERIPH_I2S1_MODULE);
+	}
+}
+
+unsigned i2s_parallel_get_loop_count(i2s_dev_t *dev) {
+	return loop_count[i2snum(dev)];
+}
+
 void i2s_parallel_flip_to_buffer(i2s_dev_t *dev, int bufid) {
 	int no = i2snum(dev);
 
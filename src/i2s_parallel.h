@@ -31,9 +31,21 @@ typedef struct {
 	i2s_parallel_buffer_desc_t *bufa;
 	// set to NULL if no double buffering is required
 	i2s_parallel_buffer_desc_t *bufb;
+	// optional, called from the ISR when buffer `buf_idx` of bufa has been
+	// read by the DMA. Must be in IRAM. Set to NULL if not required
+	void (*on_eof)(int buf_idx, void *arg);
+	void *on_eof_arg;
 } i2s_parallel_config_t;
 
 void i2s_parallel_setup(i2s_dev_t *dev, const i2s_parallel_config_t *cfg);
 void i2s_parallel_flip_to_buffer(i2s_dev_t *dev, int bufid);
 
+// Stops the DMA, releases the pins and frees everything allocated by
+// i2s_parallel_setup(). The buffers of the config are not touched.
+void i2s_parallel_teardown(i2s_dev_t *dev);
+
+// Number of times the DMA went through the whole descriptor chain since boot.
+// Keeps counting across i2s_parallel_teardown() and setup.
+unsigned i2s_parallel_get_loop_count(i2s_dev_t *dev);
+
 #endif
@@ -21,6 +21,8 @@
 #include "static_ws.h"
 #include "wifi.h"
 
+#include "ani_fat.h"
+#include "ani_stats.h"
 #include "animations.h"
 #include "common.h"
 #include "font.h"
@@ -95,6 +97,7 @@ static esp_err_t mount_sd_card(const char *path) {
 	if (ret == ESP_OK) {
 		// Card has been initialized, print its properties
 		sdmmc_card_print_info(stdout, card);
+		ani_fat_init(card);
 	} else {
 		ESP_LOGE(
 			T, "Failed to mount SD card. Continuing in test-pattern mode."
@@ -132,9 +135,33 @@ void init_log() {
 	}
 }
 
+// Returns a copy of the settings which reinit_rgb() depends on
+static cJSON *copy_panel_settings() {
+	static const char *names[] = {
+		"panel", "panel_io", "layout", "calibration"
+	};
+	cJSON *jCopy = cJSON_CreateObject();
+	for (int i = 0; jCopy && i < sizeof(names) / sizeof(names[0]); i++) {
+		cJSON *j = jGet(getSettings(), names[i]);
+		if (j)
+			cJSON_AddItemToObject(
+				jCopy, names[i], cJSON_Duplicate(j, true)
+			);
+	}
+	return jCopy;
+}
+
+static void ws_send_text(httpd_req_t *req, char *buf, int len) {
+	httpd_ws_frame_t wsf = {0};
+	wsf.type = HTTPD_WS_TYPE_TEXT;
+	wsf.payload = (uint8_t *)buf;
+	wsf.len = len;
+	httpd_ws_send_frame(req, &wsf);
+}
+
 // This handles websocket traffic, needs ESP-IDF > 4.2.x
 static esp_err_t ws_handler(httpd_req_t *req) {
-	static char ret_buffer[64];
+	static char ret_buffer[2048];
 	int ret_len = -1;
 
 	if (req->method == HTTP_GET) {
@@ -171,12 +198,21 @@ static esp_err_t ws_handler(httpd_req_t *req) {
 				wsDumpRtc(req, false);
 			break;
 
-		case 'b':
+		case 'b': {
 			// read / write settings.json
+			cJSON *jOld = wsf.len > 1 ? copy_panel_settings() : NULL;
 			settings_ws_handler(req, &wsf.payload[1], wsf.len - 1);
-			if (wsf.len > 1)
+			if (wsf.len > 1) {
 				init_log();
+				// only a change of the panel settings needs a reinit
+				cJSON *jNew = copy_panel_settings();
+				if (!cJSON_Compare(jOld, jNew, true))
+					reinit_rgb();
+				cJSON_Delete(jNew);
+			}
+			cJSON_Delete(jOld);
 			break;
+		}
 
 		case 'r':
 			esp_wifi_disconnect();
@@ -188,25 +224,35 @@ static esp_err_t ws_handler(httpd_req_t *req) {
 		case 'h':
 			ret_len = snprintf(
 				ret_buffer, sizeof(ret_buffer),
-				"h{\"heap\": %ld, \"min_heap\": %ld}", esp_get_free_heap_size(),
-				esp_get_minimum_free_heap_size()
+				"h{\"heap\": %ld, \"min_heap\": %ld, \"refresh\": %.1f, "
+				"\"refresh_model\": %.1f, \"current\": %.0f, "
+				"\"brightness\": %d}",
+				esp_get_free_heap_size(), esp_get_minimum_free_heap_size(),
+				get_refresh_rate(), get_refresh_rate_model(), get_led_current(),
+				get_limited_brightness()
 			);
 			break;
+
+		case 'l': {
+			// latency histograms of the animation playback, too long for
+			// ret_buffer with the ones of each animation
+			int len = ani_stats_json(NULL, 0) + 64;
+			char *buf = malloc(len + 1);
+			if (buf == NULL)
+				break;
+			buf[0] = 'l';
+			len = MIN(ani_stats_json(&buf[1], len), len - 1);
+			ws_send_text(req, buf, len + 1);
+			free(buf);
+			break;
+		}
 		}
 	}
 	free(wsf.payload);
 
 	// Send reply if needed
-	if (ret_len >= 0) {
-		if (ret_len > sizeof(ret_buffer))
-			ret_len = sizeof(ret_buffer);
-
-		httpd_ws_frame_t ret_wsf = {0};
-		ret_wsf.type = HTTPD_WS_TYPE_TEXT;
-		ret_wsf.payload = (uint8_t *)ret_buffer;
-		ret_wsf.len = ret_len;
-		httpd_ws_send_frame(req, &ret_wsf);
-	}
+	if (ret_len >= 0)
+		ws_send_text(req, ret_buffer, MIN(ret_len, sizeof(ret_buffer)));
 	return ESP_OK;
 }
 
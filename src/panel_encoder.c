@@ -0,0 +1,244 @@
+// Encodes the framebuffer into HUB75 bitplanes
+
+#include "panel_encoder.h"
+#include "common.h"
+#include "frame_buffer.h"
+#include "val2pwm.h"
+#include <math.h>
+
+// bits lost when going from the 16 bit intensity to BITPLANE_CNT bits
+#define DITHER_SHIFT (16 - BITPLANE_CNT)
+
+static const uint8_t bayer4[4][4] = {
+	{0, 8, 2, 10}, {12, 4, 14, 6}, {3, 11, 1, 9}, {15, 7, 13, 5}
+};
+
+void enc_init(panel_encoder_t *e, bool is_gamma, int dither_mode) {
+	for (int ch = 0; ch < 3; ch++)
+		for (int i = 0; i < 256; i++)
+			e->lut[ch][i] = is_gamma ? valToPwm16(i) : i * 257;
+
+	e->dither_mode = dither_mode;
+	for (int y = 0; y < 4; y++)
+		for (int x = 0; x < 4; x++)
+			e->dither_tab[y][x] = 0;
+}
+
+void enc_calibrate(
+	panel_encoder_t *e, int ch, float gain, float gamma, float black
+) {
+	for (int i = 0; i < 256; i++) {
+		float v = e->lut[ch][i] / 65535.0f;
+		if (gamma > 0)
+			v = powf(i / 255.0f, gamma);
+		if (i > 0)
+			v = black + (1 - black) * v;
+		v = v * gain * 65535 + 0.5f;
+		e->lut[ch][i] = v < 0 ? 0 : v > 65535 ? 65535 : v;
+	}
+}
+
+// Set up the thresholds of the next frame. In temporal mode, the pattern is
+// shifted to the position of the next Bayer index every frame, so each pixel
+// walks through all 16 thresholds in 16 frames
+static void dither_frame(panel_encoder_t *e, unsigned frm) {
+	int ox = 0, oy = 0;
+	if (e->dither_mode >= 2) {
+		for (int i = 0; i < 16; i++) {
+			if (bayer4[i / 4][i % 4] == (frm & 15)) {
+				ox = i % 4;
+				oy = i / 4;
+			}
+		}
+	}
+	for (int y = 0; y < 4; y++)
+		for (int x = 0; x < 4; x++)
+			e->dither_tab[y][x] =
+				(bayer4[(y + oy) & 3][(x + ox) & 3] << DITHER_SHIFT) / 16;
+}
+
+// Returns the blended pixel at framebuffer index `i`, mapped through the
+// intensity table, dithered if enabled and truncated to BITPLANE_CNT bits
+// per channel
+static inline unsigned get_pixel(const panel_encoder_t *e, unsigned i) {
+	unsigned c = getBlendedPixelRawIdx(i);
+	unsigned d = e->dither_tab[(i / DISPLAY_WIDTH) & 3][i & 3];
+	unsigned res = 0;
+	for (int ch = 0; ch < 3; ch++) {
+		unsigned v = (e->lut[ch][(c >> (ch * 8)) & 0xFF] + d) >> DITHER_SHIFT;
+		if (v >= (1 << BITPLANE_CNT))
+			v = (1 << BITPLANE_CNT) - 1;
+		res |= v << (ch * 8);
+	}
+	return res;
+}
+
+// Position of DMA word `x` in the bitplane memory
+static inline int word_pos(const panel_encoder_t *e, int x) {
+	return e->is_8bit ? ESP32_TX_FIFO_POSITION_ADJUST8(x) :
+						ESP32_TX_FIFO_POSITION_ADJUST(x);
+}
+
+// Set or clear the OE_N bit in columns [x0, x1) of all rows of a bitplane
+static void patch_oe_columns(panel_encoder_t *e, int pl, int x0, int x1) {
+	const int row_len = e->layout.row_len;
+	const int n_rows = enc_rows(e);
+	const int y0 = n_rows > e->layout.scan;  // skip the dark first row
+	for (int x_ = x0; x_ < x1; x_++) {
+		int x = word_pos(e, x_);
+		bool is_on = x_ >= e->oe_start[pl] && x_ < e->oe_stop[pl];
+		if (e->is_8bit) {
+			uint8_t *p = &e->bitplane8[pl][y0 * row_len + x];
+			for (int y = y0; y < n_rows; y++, p += row_len)
+				*p = is_on ? *p & ~BIT8_OE_N : *p | BIT8_OE_N;
+			continue;
+		}
+		uint16_t *p = &e->bitplane[pl][y0 * row_len + x];
+		for (int y = y0; y < n_rows; y++) {
+			if (is_on)
+				*p &= ~BIT_OE_N;
+			else
+				*p |= BIT_OE_N;
+			p += row_len;
+		}
+	}
+}
+
+void enc_set_brightness(panel_encoder_t *e, int br) {
+	const int row_len = e->layout.row_len;
+	for (int pl = 0; pl < BITPLANE_CNT; pl++) {
+		// The lower bitplanes of the hybrid BCM schedule get a shorter window
+		const int len = row_len - e->oe_guard;
+		int w = MIN(bcm_oe_width(&e->bcm, pl, br), len);
+		int start = e->oe_guard + (len - w) / 2;
+		int stop = start + w;
+		if (start == e->oe_start[pl] && stop == e->oe_stop[pl])
+			continue;
+
+		int old_start = e->oe_start[pl], old_stop = e->oe_stop[pl];
+		e->oe_start[pl] = start;
+		e->oe_stop[pl] = stop;
+
+		if (e->bitplane[pl] == NULL)
+			continue;
+
+		// only the columns entering or leaving the window need an update
+		patch_oe_columns(e, pl, MIN(start, old_start), MAX(start, old_start));
+		patch_oe_columns(e, pl, MIN(stop, old_stop), MAX(stop, old_stop));
+	}
+}
+
+void enc_update(panel_encoder_t *e, unsigned frm) {
+	const int row_len = e->layout.row_len;
+	const int scan = e->layout.scan;
+	const int n_rows = enc_rows(e);
+	const unsigned bit_lat = e->is_8bit ? BIT8_LAT : BIT_LAT;
+	const unsigned bit_oe_n = e->is_8bit ? BIT8_OE_N : BIT_OE_N;
+
+	if (e->dither_mode)
+		dither_frame(e, frm);
+
+	uint32_t lit_r = 0, lit_g = 0, lit_b = 0;
+
+	// Walk the DMA words in the order they are shifted out
+	const layout_map_t *m = e->map;
+	for (int y = 0; y < n_rows; y++) {
+		// Precalculate line bits of the *previous* line, which is the one we're
+		// displaying now
+		unsigned y_prev = (y + n_rows - 1) % n_rows % scan;
+		unsigned lbits = 0;
+
+		// in 8 bit mode, the row address is set by the EOF interrupt
+		if (e->is_8bit)
+			y_prev = 0;
+
+		if (y_prev & 1)
+			lbits |= BIT_A;
+		if (y_prev & 2)
+			lbits |= BIT_B;
+		if (y_prev & 4)
+			lbits |= BIT_C;
+		if (y_prev & 8)
+			lbits |= BIT_D;
+		if (y_prev & 16)
+			lbits |= BIT_E;
+
+		// the appended row only latches blank data
+		bool is_blank = y >= scan;
+		// the previous latch is blank or belongs to another bitplane
+		bool is_dark = n_rows > scan && y == 0;
+
+		uint16_t *row[BITPLANE_CNT];
+		uint8_t *row8[BITPLANE_CNT];
+		for (int pl = 0; pl < BITPLANE_CNT; pl++) {
+			row[pl] = &e->bitplane[pl][y * row_len];
+			row8[pl] = &e->bitplane8[pl][y * row_len];
+		}
+
+		for (int x_ = 0; x_ < row_len; x_++) {
+			int x = word_pos(e, x_);
+			unsigned v = lbits;
+
+			// latch pulse at the end of shifting in row - data
+			if (x_ == (row_len - 1))
+				v |= bit_lat;
+
+			// Does alpha blending of all graphical layers, a rather
+			// expensive operation and best kept out of innermost loop.
+			unsigned c1 = 0, c2 = 0;
+			if (!is_blank) {
+				c1 = get_pixel(e, m->top);
+				c2 = get_pixel(e, m->bot);
+				m++;
+			}
+
+			// no carry between the 7 bit channels
+			unsigned s = c1 + c2;
+			lit_r += s & 0xFF;
+			lit_g += (s >> 8) & 0xFF;
+			lit_b += s >> 16;
+
+			for (int pl = 0; pl < BITPLANE_CNT; pl++) {
+				// reset RGB bits
+				unsigned v_ = v;
+
+				// Do not show image while the line bits are changing
+				if (is_dark || !(x_ >= e->oe_start[pl] && x_ < e->oe_stop[pl]))
+					v_ |= bit_oe_n;
+
+				// bitmask for pixel data in input for this bitplane
+				unsigned mask = 1 << pl;
+
+				if (c1 & (mask << 0))
+					v_ |= BIT_R1;
+				if (c1 & (mask << 8))
+					v_ |= BIT_G1;
+				if (c1 & (mask << 16))
+					v_ |= BIT_B1;
+				if (c2 & (mask << 0))
+					v_ |= BIT_R2;
+				if (c2 & (mask << 8))
+					v_ |= BIT_G2;
+				if (c2 & (mask << 16))
+					v_ |= BIT_B2;
+
+				// Save the calculated value to the bitplane memory
+				if (e->is_8bit)
+					row8[pl][x] = v_;
+				else
+					row[pl][x] = v_;
+			}
+		}
+	}
+	e->lit[0] = lit_r;
+	e->lit[1] = lit_g;
+	e->lit[2] = lit_b;
+}
+
+float enc_current(const panel_encoder_t *e, int br, float led_ma) {
+	// A channel value q is on for q * br / 2^n_lsb columns per refresh, see
+	// bcm_weight(). A refresh takes bcm.len bitplanes.
+	float on = (float)(e->lit[0] + e->lit[1] + e->lit[2]) * br /
+		(1 << e->bcm.n_lsb);
+	return led_ma * on / ((float)e->bcm.len * enc_bitplane_words(e));
+}
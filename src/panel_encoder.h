@@ -0,0 +1,138 @@
+#ifndef PANEL_ENCODER_H
+#define PANEL_ENCODER_H
+#include "bcm_schedule.h"
+#include "panel_layout.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Converts the blended framebuffer into the bitplanes shifted out by the I2S
+// DMA. Hardware independent, so it can be tested and benchmarked on the host
+// (dev/panel_sim)
+
+// bits / color, larger values = more sub-frames and more flicker, max: 8
+#define BITPLANE_CNT 7
+
+// -------------------------------------------
+//  Meaning of the bits in a 16 bit DMA word
+// -------------------------------------------
+// Upper half RGB
+#define BIT_R1 (1 << 0)
+#define BIT_G1 (1 << 1)
+#define BIT_B1 (1 << 2)
+// Lower half RGB
+#define BIT_R2 (1 << 3)
+#define BIT_G2 (1 << 4)
+#define BIT_B2 (1 << 5)
+// Row address
+#define BIT_A (1 << 6)
+#define BIT_B (1 << 7)
+#define BIT_C (1 << 8)
+#define BIT_D (1 << 9)
+#define BIT_E (1 << 10)
+// Control
+#define BIT_LAT (1 << 11)
+#define BIT_OE_N (1 << 12)
+// -1 = don't care
+
+// 16 bit parallel mode - Save the calculated value to the bitplane memory
+// in reverse order to account for I2S Tx FIFO mode1 ordering
+#define ESP32_TX_FIFO_POSITION_ADJUST(x) (((x)&1U) ? (x - 1) : (x + 1))
+
+// ------------------------------------------
+//  Meaning of the bits in an 8 bit DMA byte
+// ------------------------------------------
+// RGB bits are the same as above. The row address is not part of the DMA
+// stream, it is set by the EOF interrupt of each row (see rgb_led_panel.c)
+#define BIT8_LAT (1 << 6)
+#define BIT8_OE_N (1 << 7)
+
+// 8 bit parallel mode - the I2S Tx FIFO (mode 1, see i2s_parallel.c) sends
+// the upper 16 bit half of a word first, each half low byte first
+#define ESP32_TX_FIFO_POSITION_ADJUST8(x) ((x) ^ 2U)
+
+typedef struct {
+	// enc_bitplane_words() DMA words per bitplane, 16 or 8 bit wide
+	union {
+		uint16_t *bitplane[BITPLANE_CNT];
+		uint8_t *bitplane8[BITPLANE_CNT];
+	};
+	bool is_8bit;
+
+	// Geometry of the panel chain and the pixel to DMA word mapping table
+	panel_layout_t layout;
+	const layout_map_t *map;
+
+	// Order and repetitions of the bitplanes in the DMA descriptor chain
+	bcm_schedule_t bcm;
+
+	// The output enable window [columns] of each bitplane currently encoded
+	// in the bitplanes
+	int oe_start[BITPLANE_CNT];
+	int oe_stop[BITPLANE_CNT];
+
+	// Columns at the start of each row where OE stays off. In 8 bit mode the
+	// row address changes there, see rgb_led_panel.c
+	int oe_guard;
+
+	// 0 = off, 1 = spatial (4x4 Bayer pattern), 2 = spatial + temporal
+	int dither_mode;
+
+	// 16 bit intensity of each 8 bit value of the R, G and B channel. Holds
+	// the gamma correction and the calibration of the panel
+	uint16_t lut[3][256];
+
+	// dither threshold for each position of the 4x4 pattern in this frame
+	uint16_t dither_tab[4][4];
+
+	// Sum of the quantized R, G and B values of the last encoded frame.
+	// Proportional to the on-time of all LEDs, for enc_current()
+	uint32_t lit[3];
+} panel_encoder_t;
+
+// Number of rows of DMA words in a bitplane. The panel shows the previously
+// latched row while the next one is shifted in, so the last row of a
+// bitplane would be shown during the first row of the next slot, with the OE
+// window of a different bitplane. With a hybrid BCM schedule the windows
+// differ, hence a blank row is appended, which shows the last row with its
+// own window. The first row of such a bitplane is always dark.
+static inline int enc_rows(const panel_encoder_t *e) {
+	return e->layout.scan + (e->bcm.n_lsb > 0);
+}
+
+// Size of a bitplane [DMA words]
+static inline int enc_bitplane_words(const panel_encoder_t *e) {
+	return enc_rows(e) * e->layout.row_len;
+}
+
+// Size of a bitplane [bytes]
+static inline int enc_bitplane_bytes(const panel_encoder_t *e) {
+	return enc_bitplane_words(e) * (e->is_8bit ? 1 : 2);
+}
+
+// Set up the intensity table and dithering. `layout`, `map`, `bcm`, `is_8bit`
+// and the bitplanes must be filled in before the first call to enc_update()
+void enc_init(panel_encoder_t *e, bool is_gamma, int dither_mode);
+
+// Replace the intensity table of channel `ch` (0 = R, 1 = G, 2 = B).
+// `gain`: 0 .. 1, for white balance. `gamma`: exponent of a power law,
+// 0 = keep the curve set by enc_init(). `black`: lowest intensity of non zero
+// values, as fraction of full scale, for LEDs which don't light up below it
+void enc_calibrate(
+	panel_encoder_t *e, int ch, float gain, float gamma, float black
+);
+
+// Move the output enable windows to `br` columns, centered between 2 strobes
+// and after the oe_guard columns, which also limit the width.
+// Only the columns where the old and new window differ are rewritten.
+void enc_set_brightness(panel_encoder_t *e, int br);
+
+// Blend the framebuffer layers and encode them into the bitplanes.
+// `frm` is the frame counter, for temporal dithering
+void enc_update(panel_encoder_t *e, unsigned frm);
+
+// Estimated average LED current [mA] of the last encoded frame at a
+// brightness of `br` columns, if a LED draws `led_ma` while it is on.
+// Proportional to `br`.
+float enc_current(const panel_encoder_t *e, int br, float led_ma);
+
+#endif
@@ -0,0 +1,96 @@
+// Pixel to DMA word mapping for chains of HUB75 panels
+
+#include "panel_layout.h"
+#include "esp_log.h"
+#include <string.h>
+
+static const char *T = "LAYOUT";
+
+// rows driven by one row address in one half of a panel
+static int rows_per_addr(scan_pattern_t pattern) {
+	return pattern == SCAN_ZIGZAG8 ? 2 : 1;
+}
+
+int layout_init(panel_layout_t *l) {
+	if (l->panel_w <= 0 || l->panel_h <= 0 || l->scan <= 0 || l->cols <= 0 ||
+		l->rows <= 0) {
+		ESP_LOGE(T, "invalid panel geometry");
+		return -1;
+	}
+
+	if (l->panel_h / 2 != l->scan * rows_per_addr(l->pattern)) {
+		ESP_LOGE(
+			T, "panel height %d does not fit to 1/%d scan", l->panel_h, l->scan
+		);
+		return -1;
+	}
+
+	if (l->scan > 32) {
+		ESP_LOGE(T, "more than 32 row addresses are not supported");
+		return -1;
+	}
+
+	if (l->pattern == SCAN_ZIGZAG8 && l->panel_w % 8) {
+		ESP_LOGE(T, "panel width must be a multiple of 8");
+		return -1;
+	}
+
+	l->width = l->panel_w * l->cols;
+	l->height = l->panel_h * l->rows;
+	l->row_len = l->width * l->height / 2 / l->scan;
+
+	// 0xFFFF marks unused entries in the map
+	if (l->y0 < 0 || l->width * (l->y0 + l->height) >= 0xFFFF) {
+		ESP_LOGE(T, "display is too large");
+		return -1;
+	}
+
+	return 0;
+}
+
+int layout_build_map(const panel_layout_t *l, layout_map_t *map) {
+	const int n_words = l->width * l->height / 2;
+	const int half_h = l->panel_h / 2;
+	// words shifted into a single panel per row address
+	const int panel_len = l->row_len / (l->cols * l->rows);
+
+	// mark all words as unused
+	memset(map, 0xFF, n_words * sizeof(layout_map_t));
+
+	for (int y = 0; y < l->height; y++) {
+		for (int x = 0; x < l->width; x++) {
+			int gc = x / l->panel_w, gr = y / l->panel_h;
+			int px = x % l->panel_w, py = y % l->panel_h;
+
+			// position of the panel in the chain, 0 = first data shifted out
+			int k = gr * l->cols + gc;
+			if (l->is_serpentine && (gr & 1)) {
+				k = gr * l->cols + l->cols - 1 - gc;
+				px = l->panel_w - 1 - px;
+				py = l->panel_h - 1 - py;
+			}
+
+			// which half of the panel, row address and position in the
+			// panels shift register
+			bool is_bot = py >= half_h;
+			int yy = py % half_h;
+			int addr = yy % l->scan;
+			int sp = px;
+			if (l->pattern == SCAN_ZIGZAG8) {
+				if (yy < l->scan)
+					sp = px + ((px >> 3) + 1) * 8;
+				else
+					sp = px + (px >> 3) * 8;
+			}
+
+			int w = addr * l->row_len + k * panel_len + sp;
+			uint16_t *p = is_bot ? &map[w].bot : &map[w].top;
+			if (*p != 0xFFFF) {
+				ESP_LOGE(T, "pixel %d, %d maps to word %d twice", x, y, w);
+				return -1;
+			}
+			*p = x + (y + l->y0) * l->width;
+		}
+	}
+	return 0;
+}
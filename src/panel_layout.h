@@ -0,0 +1,51 @@
+#ifndef PANEL_LAYOUT_H
+#define PANEL_LAYOUT_H
+#include <stdbool.h>
+#include <stdint.h>
+
+// Describes how the framebuffer maps to the HUB75 shift registers of a chain
+// of panels. Hardware independent, the mapping is computed once at init.
+
+// How the row addresses of a single panel map to its pixels
+typedef enum {
+	// Each row address drives one row in the upper and one in the lower half
+	// (1/16 scan 64x32 panels, 1/32 scan 64x64 panels with the E line)
+	SCAN_DIRECT,
+	// Each row address drives 2 rows per half. The shift register alternates
+	// between them in blocks of 8 pixels (1/8 scan 32 pixel high panels)
+	SCAN_ZIGZAG8,
+} scan_pattern_t;
+
+typedef struct {
+	int panel_w;			// width of a single panel [pixels]
+	int panel_h;			// height of a single panel [pixels]
+	int scan;				// number of row addresses (16 for 1/16 scan)
+	scan_pattern_t pattern; // how the row addresses map to the pixels
+	int cols;				// number of panels in x direction
+	int rows;				// number of panels in y direction
+	bool is_serpentine;		// every 2nd row of panels is chained right to left
+							// and mounted upside down
+	int y0;					// first framebuffer row driven by this chain
+
+	// filled in by layout_init()
+	int width;	 // width of the whole display [pixels]
+	int height;	 // height of the whole display [pixels]
+	int row_len; // number of DMA words shifted out per row address
+} panel_layout_t;
+
+// Each DMA word carries one pixel of the upper and one of the lower half
+// of the panels. Both are given as framebuffer index (x + (y + y0) * width)
+typedef struct {
+	uint16_t top;
+	uint16_t bot;
+} layout_map_t;
+
+// Checks the geometry and fills in the derived fields. Returns 0 on success
+int layout_init(panel_layout_t *l);
+
+// Fills `map` with width * height / 2 entries, one for each DMA word of a
+// bitplane, in the order they are shifted out: `row_len` words for row
+// address 0, then for row address 1, etc. Returns 0 on success
+int layout_build_map(const panel_layout_t *l, layout_map_t *map);
+
+#endif
@@ -1,16 +1,21 @@
 #include "rgb_led_panel.h"
 #include "assert.h"
 #include "common.h"
+#include "esp_attr.h"
 #include "esp_heap_caps.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "frame_buffer.h"
+#include "freertos/semphr.h"
 #include "i2s_parallel.h"
 #include "json_settings.h"
+#include "panel_encoder.h"
 
 #include "esp_private/periph_ctrl.h"
 #include "rom/gpio.h"
 #include "rom/lldesc.h"
 #include "soc/gpio_periph.h"
+#include "soc/gpio_struct.h"
 #include "soc/i2s_reg.h"
 #include "soc/i2s_struct.h"
 #include "soc/io_mux_reg.h"
@@ -18,39 +23,15 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
-// bits / color, larger values = more sub-frames and more flicker, max: 8
-#define BITPLANE_CNT 7
-
 // x * DISPLAY_HEIGHT RGB leds, 2 pixels per 16-bit value...
+// Any panel layout covering the framebuffer fits into this
 #define BITPLANE_SZ (DISPLAY_WIDTH * DISPLAY_HEIGHT / 2) // [16 bit words]
 
-// -------------------------------------------
-//  Meaning of the bits in a 16 bit DMA word
-// -------------------------------------------
-// Upper half RGB
-#define BIT_R1 (1 << 0)
-#define BIT_G1 (1 << 1)
-#define BIT_B1 (1 << 2)
-// Lower half RGB
-#define BIT_R2 (1 << 3)
-#define BIT_G2 (1 << 4)
-#define BIT_B2 (1 << 5)
-// Row address
-#define BIT_A (1 << 6)
-#define BIT_B (1 << 7)
-#define BIT_C (1 << 8)
-#define BIT_D (1 << 9)
-#define BIT_E (1 << 10)
-// Control
-#define BIT_LAT (1 << 11)
-#define BIT_OE_N (1 << 12)
-// -1 = don't care
-
-// 16 bit parallel mode - Save the calculated value to the bitplane memory
-// in reverse order to account for I2S Tx FIFO mode1 ordering
-#define ESP32_TX_FIFO_POSITION_ADJUST(x) (((x)&1U) ? (x - 1) : (x + 1))
+// max. number of panel chains, each driven by its own I2S peripheral
+#define N_CHAINS 2
 
 static const char *T = "LED_PANEL";
 
@@ -58,59 +39,324 @@ unsigned g_frames = 0; // frame counter
 unsigned g_f_del = 33; // delay between frames [ms]
 
 // Double buffering has been removed to save RAM. No visual differences!
-uint16_t *bitplane[BITPLANE_CNT] = {0};
-// DISPLAY_WIDTH * 32 * 3 array with image data, 8R8G8B
+// Each chain has its own encoder, which owns the bitplanes, layout, BCM
+// schedule and OE windows. Chain 0 is driven by I2S1, chain 1 by I2S0
+static panel_encoder_t enc[N_CHAINS];
+static int n_chains = 1;
+
+static i2s_dev_t *const chain_dev[N_CHAINS] = {&I2S1, &I2S0};
+
+// Mapping tables of framebuffer pixels to DMA words, referenced by enc.map
+static layout_map_t *layout_map[N_CHAINS] = {NULL};
 
 // .json configurable parameters
-static int ledBrightness = 0;
+static int ledBrightness = 2;
 static int low_power_brightness = 20;  // max. brightness when USB-PD fails to negotiate
 
-void set_brightness(int value) {
+// Current limit [mA], 0 = off. Uses low_power_ma when USB-PD fails
+static float led_ma = 10;  // current of a single LED while it is on
+static float max_ma = 0;
+static float low_power_ma = 0;
+
+// Estimated LED current [mA] and brightness after the current limit
+static float cur_ma = 0;
+static int cur_brightness = 0;
+
+// Expected and measured panel refresh rate [Hz]
+static float refresh_rate_model = 0;
+static float refresh_rate = 0;
+
+// Serializes OE_N patching against the encoder in updateFrame()
+static SemaphoreHandle_t oeMutex = NULL;
+
+// Encodes chain 1 while updateFrame() encodes chain 0, see enc_task()
+static TaskHandle_t t_enc = NULL;
+static TaskHandle_t t_enc_waiting = NULL;
+
+// ---------------------------------------------------------------
+//  8 bit DMA mode: the row address is set by GPIO from the EOF ISR
+// ---------------------------------------------------------------
+static bool is_8bit = false;
+
+// Rows the EOF interrupt runs ahead of the latch, due to the I2S Tx FIFO
+static int addr_lag = 0;
+
+// GPIO output register bits of each row address, for GPIO 0-31 and 32-39
+typedef struct {
+	uint32_t mask_lo, mask_hi;
+	uint32_t lo[32], hi[32];
+	int pins[5];
+} addr_gpio_t;
+
+static addr_gpio_t addr_gpio[N_CHAINS];
+
+static void init_addr_gpio(addr_gpio_t *ag, const int *pins) {
+	memset(ag, 0, sizeof(addr_gpio_t));
+	for (int b = 0; b < 5; b++) {
+		int pin = pins[b];
+		ag->pins[b] = pin;
+		if (pin < 0)
+			continue;
+		gpio_pad_select_gpio(pin);
+		gpio_set_direction(pin, GPIO_MODE_OUTPUT);
+		for (int a = 0; a < 32; a++) {
+			if (!(a & (1 << b)))
+				continue;
+			if (pin < 32)
+				ag->lo[a] |= 1 << pin;
+			else
+				ag->hi[a] |= 1 << (pin - 32);
+		}
+		if (pin < 32)
+			ag->mask_lo |= 1 << pin;
+		else
+			ag->mask_hi |= 1 << (pin - 32);
+	}
+}
+
+// Called after each row of a bitplane has been read by the DMA. Sets the
+// row address to the row latched at its end, which is shown while the next
+// row is shifted in. The write is not synchronized with the pixel clock, so
+// the OE window of each row starts after `addr_guard` dark columns, which
+// have to cover the interrupt latency
+static void IRAM_ATTR row_isr(int buf_idx, void *arg) {
+	int c = (intptr_t)arg;
+	const panel_encoder_t *e = &enc[c];
+	const addr_gpio_t *ag = &addr_gpio[c];
+	int n_rows = enc_rows(e);
+	int row = (buf_idx - addr_lag + n_rows) % n_rows;
+	int a = row % e->layout.scan;
+
+	GPIO.out_w1tc = ag->mask_lo & ~ag->lo[a];
+	GPIO.out_w1ts = ag->lo[a];
+	GPIO.out1_w1tc.val = ag->mask_hi & ~ag->hi[a];
+	GPIO.out1_w1ts.val = ag->hi[a];
+}
+
+// Takes care of the power limit, then patches the OE windows of the
+// bitplanes. Must be called with oeMutex taken.
+static void patch_oe(int br) {
+	float budget = max_ma;
+	#ifdef GPIO_PD_BAD
+		// Check if we need to limit led brightness due to USB PD not giving 12 V
+		bool is_bad = gpio_get_level(GPIO_PD_BAD);
+		gpio_set_level(GPIO_LED, !is_bad);
+		if (is_bad) {
+			if (low_power_ma > 0)
+				budget = low_power_ma;
+			else if (br > low_power_brightness)
+				br = low_power_brightness;
+		}
+	#endif
+
+	// Shorten the OE window until the estimated current of the last encoded
+	// frame fits the budget
+	float ma_per_col = 0;
+	for (int c = 0; c < n_chains; c++)
+		ma_per_col += enc_current(&enc[c], 1, led_ma);
+	if (budget > 0 && ma_per_col * br > budget)
+		br = budget / ma_per_col;
+
+	cur_brightness = br;
+	cur_ma = ma_per_col * br;
+
+	for (int c = 0; c < n_chains; c++)
+		enc_set_brightness(&enc[c], br);
+}
+
+static int clamp_brightness(int value) {
 	if (value < 0)
 		value = 0;
 
-	if (value > DISPLAY_WIDTH - 2)
-		value = DISPLAY_WIDTH - 2;
+	if (value > enc[0].layout.row_len - enc[0].oe_guard - 2)
+		value = enc[0].layout.row_len - enc[0].oe_guard - 2;
+
+	return value;
+}
 
+void set_brightness(int value) {
+	value = clamp_brightness(value);
 	ESP_LOGD(T, "set_brightness(%d)", value);
 	ledBrightness = value;
+
+	if (oeMutex == NULL)
+		return;
+
+	xSemaphoreTake(oeMutex, portMAX_DELAY);
+	patch_oe(value);
+	xSemaphoreGive(oeMutex);
 }
 
-void init_rgb() {
-	set_brightness(2);
+// Load the panel geometry from the `layout` dictionary and build the mapping
+// tables. Each chain drives `rows` rows of panels, stacked from the top.
+// Falls back to a single chain of 2 x 64x32 1/16 scan panels if the layout
+// doesn't fit the framebuffer.
+static void init_layout() {
+	panel_layout_t layout = {0};
+	cJSON *jLayout = jGet(getSettings(), "layout");
+
+	layout.panel_w = jGetI(jLayout, "panel_width", 64);
+	layout.panel_h = jGetI(jLayout, "panel_height", 32);
+	layout.scan = jGetI(jLayout, "scan", 16);
+	layout.cols = jGetI(jLayout, "cols", 2);
+	layout.rows = jGetI(jLayout, "rows", 1);
+	layout.is_serpentine = jGetB(jLayout, "is_serpentine", false);
+	layout.y0 = 0;
+	const char *pattern = jGetS(jLayout, "scan_pattern", "direct");
+	layout.pattern =
+		strcmp(pattern, "zigzag8") == 0 ? SCAN_ZIGZAG8 : SCAN_DIRECT;
+	n_chains = jGetI(jLayout, "chains", 1);
+
+	bool is_ok = n_chains >= 1 && n_chains <= N_CHAINS &&
+		layout_init(&layout) == 0 && layout.width == DISPLAY_WIDTH &&
+		layout.height * n_chains == DISPLAY_HEIGHT;
+
+	if (!is_ok) {
+		// the framebuffer size is set at build time, see common.h
+		ESP_LOGE(
+			T, "layout of %d chain(s) of %dx%d does not match the %dx%d "
+			"framebuffer, using default", n_chains, layout.width,
+			layout.height, DISPLAY_WIDTH, DISPLAY_HEIGHT
+		);
+		layout = (panel_layout_t){
+			.panel_w = DISPLAY_WIDTH / 2, .panel_h = DISPLAY_HEIGHT,
+			.scan = DISPLAY_HEIGHT / 2, .pattern = SCAN_DIRECT,
+			.cols = 2, .rows = 1,
+		};
+		layout_init(&layout);
+		n_chains = 1;
+	}
 
-	initFb();
+	for (int c = 0; c < n_chains; c++) {
+		if (layout_map[c] == NULL) {
+			layout_map[c] =
+				malloc(BITPLANE_SZ / n_chains * sizeof(layout_map_t));
+			assert(layout_map[c] && "Can't allocate layout map");
+		}
+		layout.y0 = c * layout.height;
+		layout_build_map(&layout, layout_map[c]);
+		enc[c].layout = layout;
+		enc[c].map = layout_map[c];
+	}
 
-	i2s_parallel_buffer_desc_t bufdesc[1 << BITPLANE_CNT];
-	i2s_parallel_config_t cfg;
+	ESP_LOGI(
+		T, "layout: %d chain(s) of %d x %d panels of %dx%d, 1/%d scan, "
+		"row_len: %d", n_chains, layout.cols, layout.rows, layout.panel_w,
+		layout.panel_h, layout.scan, layout.row_len
+	);
+}
 
-	//--------------------------
-	// IO pins configuration
-	//--------------------------
-	// get `panel_io` dictionary
-	cJSON *jPio = jGet(getSettings(), "panel_io");
+// Read the pins of a chain from a `panel_io` dictionary. In 8 bit mode, only
+// RGB, LAT and OE_N go through the DMA, the row address pins are returned
+// in `addr_pins`
+static void get_pins(
+	cJSON *jPio, i2s_parallel_config_t *cfg, int *addr_pins, bool is_default
+) {
+	#define PIN(name, def) jGetI(jPio, name, is_default ? def : -1)
+	cfg->gpio_clk = PIN("CLK", GPIO_CLK);
+	cfg->gpio_bus[0] = PIN("R1", GPIO_R1);
+	cfg->gpio_bus[1] = PIN("G1", GPIO_G1);
+	cfg->gpio_bus[2] = PIN("B1", GPIO_B1);
+	cfg->gpio_bus[3] = PIN("R2", GPIO_R2);
+	cfg->gpio_bus[4] = PIN("G2", GPIO_G2);
+	cfg->gpio_bus[5] = PIN("B2", GPIO_B2);
+	addr_pins[0] = PIN("A", GPIO_A);
+	addr_pins[1] = PIN("B", GPIO_B);
+	addr_pins[2] = PIN("C", GPIO_C);
+	addr_pins[3] = PIN("D", GPIO_D);
+	addr_pins[4] = PIN("E", GPIO_E);
+	int lat = PIN("LAT", GPIO_LAT);
+	int oe_n = PIN("OE_N", GPIO_OE_N);
+	#undef PIN
+
+	if (is_8bit) {
+		cfg->gpio_bus[6] = lat;
+		cfg->gpio_bus[7] = oe_n;
+		return;
+	}
+
+	for (int i = 0; i < 5; i++)
+		cfg->gpio_bus[6 + i] = addr_pins[i];
+	cfg->gpio_bus[11] = lat;
+	cfg->gpio_bus[12] = oe_n;
+	cfg->gpio_bus[13] = (gpio_num_t)(-1);
+	cfg->gpio_bus[14] = (gpio_num_t)(-1);
+	cfg->gpio_bus[15] = (gpio_num_t)(-1);
+}
+
+// Per channel white balance, gamma and black level, from the tables in
+// CALIBRATION_FILE (3 x 256 little endian uint16: R, G, B) if it exists,
+// otherwise from the `calibration` dictionary
+static void init_calibration(panel_encoder_t *e) {
+	FILE *f = fopen(CALIBRATION_FILE, "rb");
+	if (f) {
+		uint16_t *tab = malloc(sizeof(e->lut));
+		int ret = tab ? fread(tab, 1, sizeof(e->lut), f) : 0;
+		fclose(f);
+		if (ret == sizeof(e->lut)) {
+			memcpy(e->lut, tab, sizeof(e->lut));
+			ESP_LOGI(T, "loaded %s", CALIBRATION_FILE);
+		} else {
+			ESP_LOGE(
+				T, "%s: expected %d bytes, got %d", CALIBRATION_FILE,
+				(int)sizeof(e->lut), ret
+			);
+		}
+		free(tab);
+		return;
+	}
+
+	cJSON *jCal = jGet(getSettings(), "calibration");
+	static const char *names[3] = {"r", "g", "b"};
+	for (int ch = 0; ch < 3; ch++) {
+		cJSON *jCh = jGet(jCal, names[ch]);
+		if (jCh == NULL)
+			continue;
+		enc_calibrate(
+			e, ch, jGetD(jCh, "gain", 1.0), jGetD(jCh, "gamma", 0),
+			jGetD(jCh, "black", 0)
+		);
+	}
+}
+
+// Helper task, encodes chain 1 whenever updateFrame() asks for it. It runs
+// on core 0, opposite of the bck task (main.c) which calls updateFrame().
+// The test-pattern mode calls it from app_main on core 0, then the two
+// encodes take turns.
+static void enc_task(void *pvParameters) {
+	while (1) {
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		enc_update(&enc[1], g_frames);
+		xTaskNotifyGive(t_enc_waiting);
+	}
+}
+
+// Encodes the framebuffer into the bitplanes of all chains. Must be called
+// with the framebuffer locked and oeMutex taken.
+static void encode_frame() {
+	// the second chain is encoded by enc_task
+	if (n_chains > 1) {
+		t_enc_waiting = xTaskGetCurrentTaskHandle();
+		xTaskNotifyGive(t_enc);
+	}
+
+	enc_update(&enc[0], g_frames);
 
-	cfg.gpio_clk = jGetI(jPio, "CLK", GPIO_CLK);
-	cfg.gpio_bus[0] = jGetI(jPio, "R1", GPIO_R1);
-	cfg.gpio_bus[1] = jGetI(jPio, "G1", GPIO_G1);
-	cfg.gpio_bus[2] = jGetI(jPio, "B1", GPIO_B1);
-	cfg.gpio_bus[3] = jGetI(jPio, "R2", GPIO_R2);
-	cfg.gpio_bus[4] = jGetI(jPio, "G2", GPIO_G2);
-	cfg.gpio_bus[5] = jGetI(jPio, "B2", GPIO_B2);
-	cfg.gpio_bus[6] = jGetI(jPio, "A", GPIO_A);
-	cfg.gpio_bus[7] = jGetI(jPio, "B", GPIO_B);
-	cfg.gpio_bus[8] = jGetI(jPio, "C", GPIO_C);
-	cfg.gpio_bus[9] = jGetI(jPio, "D", GPIO_D);
-	cfg.gpio_bus[10] = jGetI(jPio, "E", GPIO_E);
-	cfg.gpio_bus[11] = jGetI(jPio, "LAT", GPIO_LAT);
-	cfg.gpio_bus[12] = jGetI(jPio, "OE_N", GPIO_OE_N);
-	cfg.gpio_bus[13] = (gpio_num_t)(-1);
-	cfg.gpio_bus[14] = (gpio_num_t)(-1);
-	cfg.gpio_bus[15] = (gpio_num_t)(-1);
-
-	cfg.bits = I2S_PARALLEL_BITS_16;
-	cfg.bufa = bufdesc;
-	cfg.bufb = NULL;
+	if (n_chains > 1)
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+	// picks up changes of the USB-PD power state and applies the current
+	// limit for the new frame
+	patch_oe(ledBrightness);
+}
+
+// Reads the settings, allocates the bitplanes and starts the DMA. Must be
+// called with the framebuffer locked and oeMutex taken.
+static void setup_panel() {
+	init_layout();
+
+	i2s_parallel_config_t cfg[N_CHAINS];
+	int addr_pins[N_CHAINS][5];
 
 	//--------------------------
 	// .json configuration
@@ -124,132 +370,209 @@ void init_rgb() {
 	// max brightness in low power mode
 	low_power_brightness = jGetI(jPanel, "low_power_brightness", 20);
 
-	// set clock divider
-	cfg.clk_div = jGetI(jPanel, "clkm_div_num", 4);
-	cfg.is_clk_inverted = jGetB(jPanel, "is_clk_inverted", true);
+	// current limit
+	led_ma = jGetD(jPanel, "led_ma", 10);
+	max_ma = jGetD(jPanel, "max_ma", 0);
+	low_power_ma = jGetD(jPanel, "low_power_ma", 0);
+
+	bool is_gamma = jGetB(jPanel, "is_gamma", true);
+	int dither = jGetI(jPanel, "dither", 0);
+	int n_lsb = jGetI(jPanel, "bcm_lsb_planes", 0);
+
+	// 8 bit DMA words halve the bitplane memory, the row address is set by
+	// the CPU once per row
+	is_8bit = jGetI(jPanel, "dma_bits", 16) == 8;
+	// without the hybrid schedule, the per-row DMA descriptors take more
+	// memory than 16 bit words would
+	if (is_8bit && n_lsb == 0) {
+		ESP_LOGW(T, "dma_bits: 8 needs bcm_lsb_planes > 0, using 16");
+		is_8bit = false;
+	}
+	if (is_8bit)
+		ESP_LOGW(T, "dma_bits: 8 is experimental, not verified on hardware");
+	addr_lag = jGetI(jPanel, "addr_lag", 0);
 
 	//--------------------------
-	// init the sub-frames
+	// IO pins configuration
 	//--------------------------
-	for (int i = 0; i < BITPLANE_CNT; i++) {
-		if (bitplane[i] == NULL) {
-			bitplane[i] =
-				(uint16_t *)heap_caps_malloc(BITPLANE_SZ * 2, MALLOC_CAP_DMA);
-			assert(bitplane[i] && "Can't allocate bitplane memory");
+	// get `panel_io` dictionary, the pins of the 2nd chain are in `chain2`
+	cJSON *jPio = jGet(getSettings(), "panel_io");
+	get_pins(jPio, &cfg[0], addr_pins[0], true);
+	if (n_chains > 1)
+		get_pins(jGet(jPio, "chain2"), &cfg[1], addr_pins[1], false);
+
+	for (int c = 0; c < n_chains; c++) {
+		// recover the color depth lost to BITPLANE_CNT < 8 and gamma
+		enc[c].is_8bit = is_8bit;
+		// the row address changes at the start of a row, keep OE off there
+		enc[c].oe_guard = 0;
+		if (is_8bit)
+			enc[c].oe_guard = MAX(0, jGetI(jPanel, "addr_guard", 16));
+		enc_init(&enc[c], is_gamma, dither);
+		init_calibration(&enc[c]);
+
+		// set clock divider
+		cfg[c].clk_div = jGetI(jPanel, "clkm_div_num", 4);
+		cfg[c].is_clk_inverted = jGetB(jPanel, "is_clk_inverted", true);
+		cfg[c].bits = is_8bit ? I2S_PARALLEL_BITS_8 : I2S_PARALLEL_BITS_16;
+		cfg[c].bufb = NULL;
+		cfg[c].on_eof = NULL;
+		cfg[c].on_eof_arg = (void *)(intptr_t)c;
+
+		// number of low bitplanes shown once with a shorter OE window
+		// instead of being repeated. Shortens the refresh cycle by ~2^n
+		bcm_schedule_init(&enc[c].bcm, BITPLANE_CNT, n_lsb);
+
+		if (is_8bit) {
+			init_addr_gpio(&addr_gpio[c], addr_pins[c]);
+			cfg[c].on_eof = row_isr;
 		}
-		memset(bitplane[i], 0, BITPLANE_SZ * 2);
 	}
+	ledBrightness = clamp_brightness(ledBrightness);
+	patch_oe(ledBrightness);
 
-	// Do binary time division setup. Essentially, we need n of plane 0, 2n of
-	// plane 1, 4n of plane 2 etc, but that needs to be divided evenly over time
-	// to stop flicker from happening. This little bit of code tries to do that
-	// more-or-less elegantly.
-	int times[BITPLANE_CNT] = {0};
-	for (int i = 0; i < ((1 << BITPLANE_CNT) - 1); i++) {
-		int ch = 0;
-
-		// Find plane that needs insertion the most
-		for (int j = 0; j < BITPLANE_CNT; j++) {
-			if (times[j] <= times[ch])
-				ch = j;
+	//--------------------------
+	// init the sub-frames
+	//--------------------------
+	// the hybrid schedule needs one more row per bitplane
+	int bp_bytes = enc_bitplane_bytes(&enc[0]);
+	int n_rows = enc_rows(&enc[0]);
+	int row_bytes = bp_bytes / n_rows;
+
+	for (int c = 0; c < n_chains; c++) {
+		for (int i = 0; i < BITPLANE_CNT; i++) {
+			if (enc[c].bitplane[i] == NULL) {
+				enc[c].bitplane[i] = (uint16_t *)heap_caps_malloc(
+					bp_bytes, MALLOC_CAP_DMA
+				);
+				assert(enc[c].bitplane[i] && "Can't allocate bitplane memory");
+			}
+			memset(enc[c].bitplane[i], 0, bp_bytes);
 		}
 
-		// Insert the plane
-		bufdesc[i].memory = bitplane[ch];
-		bufdesc[i].size = BITPLANE_SZ * 2;
+		// In 8 bit mode, each row gets its own buffer, for the EOF interrupt
+		int bufs_per_slot = is_8bit ? n_rows : 1;
+		int n_bufs = enc[c].bcm.len * bufs_per_slot;
+		i2s_parallel_buffer_desc_t *bufdesc =
+			malloc((n_bufs + 1) * sizeof(i2s_parallel_buffer_desc_t));
+		assert(bufdesc && "Can't allocate buffer descriptors");
+
+		for (int i = 0; i < n_bufs; i++) {
+			int slot = i / bufs_per_slot;
+			uint8_t *bp = enc[c].bitplane8[enc[c].bcm.slots[slot]];
+			if (is_8bit) {
+				bufdesc[i].memory = bp + (i % n_rows) * row_bytes;
+				bufdesc[i].size = row_bytes;
+			} else {
+				bufdesc[i].memory = bp;
+				bufdesc[i].size = bp_bytes;
+			}
+		}
 
-		// Magic to make sure we choose this bitplane an appropriate time later
-		// next time
-		times[ch] += (1 << (BITPLANE_CNT - ch));
+		// End markers
+		bufdesc[n_bufs].memory = NULL;
+		cfg[c].bufa = bufdesc;
 	}
 
-	// End markers
-	bufdesc[((1 << BITPLANE_CNT) - 1)].memory = NULL;
+	if (n_chains > 1 && t_enc == NULL)
+		xTaskCreatePinnedToCore(
+			&enc_task, "enc", 1024 * 2, NULL, 2, &t_enc, 0
+		);
 
-	updateFrame();
+	encode_frame();
 
-	// Setup I2S
-	i2s_parallel_setup(&I2S1, &cfg);
+	// Setup I2S, both chains run from the same clock and schedule
+	for (int c = 0; c < n_chains; c++) {
+		i2s_parallel_setup(chain_dev[c], &cfg[c]);
+		// copied into the DMA descriptors
+		free(cfg[c].bufa);
+	}
 
-	ESP_LOGI(T, "I2S setup done.");
+	refresh_rate_model = bcm_refresh_rate(
+		&enc[0].bcm, cfg[0].clk_div, enc_bitplane_words(&enc[0])
+	);
+	ESP_LOGI(
+		T, "I2S setup done. %d bit, BCM slots: %d, refresh rate: %.0f Hz",
+		is_8bit ? 8 : 16, enc[0].bcm.len, refresh_rate_model
+	);
 }
 
-void updateFrame() {
-	int br = ledBrightness;
+// Undoes setup_panel(). The bitplanes and layout maps are freed, as their
+// size depends on the settings.
+static void teardown_panel() {
+	for (int c = 0; c < n_chains; c++) {
+		// stop the DMA before freeing its buffers
+		i2s_parallel_teardown(chain_dev[c]);
+
+		if (is_8bit)
+			for (int b = 0; b < 5; b++)
+				if (addr_gpio[c].pins[b] >= 0)
+					gpio_reset_pin(addr_gpio[c].pins[b]);
+
+		for (int i = 0; i < BITPLANE_CNT; i++) {
+			heap_caps_free(enc[c].bitplane[i]);
+			enc[c].bitplane[i] = NULL;
+		}
 
-	#ifdef GPIO_PD_BAD
-		// Check if we need to limit led brightness due to USB PD not giving 12 V
-		bool is_bad = gpio_get_level(GPIO_PD_BAD);
-		gpio_set_level(GPIO_LED, !is_bad);
-		if (is_bad && br > low_power_brightness)
-			br = low_power_brightness;
-	#endif
+		free(layout_map[c]);
+		layout_map[c] = NULL;
+		enc[c].map = NULL;
+	}
+}
 
-	// center the output enable between 2 strobes
-	int oe_start = (DISPLAY_WIDTH - br) / 2;
-	int oe_stop = (DISPLAY_WIDTH + br) / 2;
+void init_rgb() {
+	if (oeMutex == NULL)
+		oeMutex = xSemaphoreCreateMutex();
+
+	initFb();
 
 	lockFrameBuffer();
+	xSemaphoreTake(oeMutex, portMAX_DELAY);
+	setup_panel();
+	xSemaphoreGive(oeMutex);
+	releaseFrameBuffer();
+}
 
-	for (unsigned int y = 0; y < DISPLAY_HEIGHT / 2; y++) {
-		// Precalculate line bits of the *previous* line, which is the one we're
-		// displaying now
-		unsigned lbits = 0;
-
-		if ((y - 1) & 1)
-			lbits |= BIT_A;
-		if ((y - 1) & 2)
-			lbits |= BIT_B;
-		if ((y - 1) & 4)
-			lbits |= BIT_C;
-		if ((y - 1) & 8)
-			lbits |= BIT_D;
-		if ((y - 1) & 16)
-			lbits |= BIT_E;
-
-		for (int x = 0; x < DISPLAY_WIDTH; x++) {
-			int x_ = ESP32_TX_FIFO_POSITION_ADJUST(x);
-			unsigned v = lbits;
-
-			// Do not show image while the line bits are changing
-			if (!(x_ >= oe_start && x_ < oe_stop))
-				v |= BIT_OE_N;
-
-			// latch pulse at the end of shifting in row - data
-			if (x_ == (DISPLAY_WIDTH - 1))
-				v |= BIT_LAT;
-
-			// Does alpha blending of all graphical layers, a rather
-			// expensive operation and best kept out of innermost loop.
-			unsigned c1 = getBlendedPixel(x_, y);
-			unsigned c2 = getBlendedPixel(x_, y + 16);
-
-			for (int pl = 0; pl < BITPLANE_CNT; pl++) {
-				// reset RGB bits
-				unsigned v_ = v;
-
-				// bitmask for pixel data in input for this bitplane
-				unsigned mask = (1 << (8 - BITPLANE_CNT + pl));
-
-				if (c1 & (mask << 0))
-					v_ |= BIT_R1;
-				if (c1 & (mask << 8))
-					v_ |= BIT_G1;
-				if (c1 & (mask << 16))
-					v_ |= BIT_B1;
-				if (c2 & (mask << 0))
-					v_ |= BIT_R2;
-				if (c2 & (mask << 8))
-					v_ |= BIT_G2;
-				if (c2 & (mask << 16))
-					v_ |= BIT_B2;
-
-				// Save the calculated value to the bitplane memory
-				bitplane[pl][y * DISPLAY_WIDTH + x] = v_;
-			}
-		}
-	}
+void reinit_rgb() {
+	int64_t t = esp_timer_get_time();
 
+	lockFrameBuffer();
+	xSemaphoreTake(oeMutex, portMAX_DELAY);
+	teardown_panel();
+	setup_panel();
+	xSemaphoreGive(oeMutex);
+	releaseFrameBuffer();
+
+	ESP_LOGI(
+		T, "reinit_rgb() took %d ms", (int)((esp_timer_get_time() - t) / 1000)
+	);
+}
+
+void update_refresh_rate() {
+	static unsigned last_cnt = 0;
+	static int64_t last_time = 0;
+
+	int64_t cur_time = esp_timer_get_time();
+	unsigned cnt = i2s_parallel_get_loop_count(chain_dev[0]);
+	if (last_time > 0 && cur_time > last_time)
+		refresh_rate = 1e6 * (cnt - last_cnt) / (cur_time - last_time);
+	last_cnt = cnt;
+	last_time = cur_time;
+}
+
+float get_refresh_rate() { return refresh_rate; }
+
+float get_refresh_rate_model() { return refresh_rate_model; }
+
+float get_led_current() { return cur_ma; }
+
+int get_limited_brightness() { return cur_brightness; }
+
+void updateFrame() {
+	lockFrameBuffer();
+	xSemaphoreTake(oeMutex, portMAX_DELAY);
+	encode_frame();
+	xSemaphoreGive(oeMutex);
 	releaseFrameBuffer();
 	g_frames++;
 }
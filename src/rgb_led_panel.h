@@ -3,9 +3,15 @@
 #include <common.h>
 
 void init_rgb();
+
+// Stops the panel DMA and sets it up again from the current settings.
+// Applies changes of `panel`, `panel_io`, `layout` and `calibration` live.
+void reinit_rgb();
 void updateFrame();
 
 // Set the global brightness of the display, range 0 .. 120
+// Only patches the OE_N bits in the bitplanes, hence cheap enough to be
+// called every frame for fades
 void set_brightness(int value);
 
 // number of updateFrame() calls since boot (frame counter)
@@ -14,6 +20,24 @@ extern unsigned g_frames;
 // delay [ms] between updateFrame() calls (determines max. global frame-rate)
 extern unsigned g_f_del;
 
+// Measures the panel refresh rate by counting the loops through the DMA
+// descriptor chain since the last call. Called once per second by stats().
+void update_refresh_rate();
+
+// panel refresh rate [Hz] of the last update_refresh_rate()
+float get_refresh_rate();
+
+// panel refresh rate [Hz] expected from clkm_div_num, the BCM schedule and
+// the panel layout
+float get_refresh_rate_model();
+
+// Estimated LED current [mA] of the current frame, from the lit LEDs and the
+// output enable window
+float get_led_current();
+
+// Brightness after the USB-PD and current limits, range 0 .. 120
+int get_limited_brightness();
+
 // blocks and displays test-patterns forever
 void tp_task(void *pvParameters);
 
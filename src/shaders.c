@@ -23,8 +23,8 @@ static const char *T = "SHADERS";
 
 void drawXorFrame(unsigned frm) {
 	static uint16_t aniZoom = 0x04, boost = 7;
-	for (int y = 0; y <= 31; y++)
-		for (int x = 0; x <= 127; x++)
+	for (int y = 0; y < DISPLAY_HEIGHT; y++)
+		for (int x = 0; x < DISPLAY_WIDTH; x++)
 			setPixel(
 				0, x, y,
 				SRGBA(
@@ -48,8 +48,8 @@ void drawBendyFrame(unsigned frm) {
 		k = ((i << 5) - 1);
 		l = ((j << 5) - 1);
 	}
-	for (int y = 0; y <= 31; y++) {
-		for (int x = 0; x <= 127; x++) {
+	for (int y = 0; y < DISPLAY_HEIGHT; y++) {
+		for (int x = 0; x < DISPLAY_WIDTH; x++) {
 			temp1 = abs(((i * y + (f * 16) / (x + 16)) % 64) - 32) * 7;
 			temp2 = abs(((j * x + (f * 16) / (y + 16)) % 64) - 32) * 7;
 			setPixel(
@@ -66,15 +66,15 @@ void drawAlienFlameFrame(unsigned frm) {
 	// (uint32_t*)g_frameBuff[0][DISPLAY_WIDTH*(DISPLAY_HEIGHT-1)-1]; uint32_t
 	// *tempP;
 	uint32_t colIndex, temp;
-	colIndex = RAND_AB(0, 127);
-	temp = getPixel(0, colIndex, 31);
-	setPixel(0, colIndex, 31, 0xFF000000 | (temp + 2));
-	colIndex = RAND_AB(0, 127);
-	temp = getPixel(0, colIndex, 31);
+	colIndex = RAND_AB(0, DISPLAY_WIDTH - 1);
+	temp = getPixel(0, colIndex, DISPLAY_HEIGHT - 1);
+	setPixel(0, colIndex, DISPLAY_HEIGHT - 1, 0xFF000000 | (temp + 2));
+	colIndex = RAND_AB(0, DISPLAY_WIDTH - 1);
+	temp = getPixel(0, colIndex, DISPLAY_HEIGHT - 1);
 	temp = scale32(127, temp);
-	setPixel(0, colIndex, 31, temp);
-	for (int y = 30; y >= 0; y--) {
-		for (int x = 0; x <= 127; x++) {
+	setPixel(0, colIndex, DISPLAY_HEIGHT - 1, temp);
+	for (int y = DISPLAY_HEIGHT - 2; y >= 0; y--) {
+		for (int x = 0; x < DISPLAY_WIDTH; x++) {
 			colIndex = RAND_AB(0, 2);
 			temp = GC(getPixel(0, x - 1, y + 1), colIndex);
 			temp += GC(getPixel(0, x, y + 1), colIndex);
@@ -44,9 +44,13 @@ const uint16_t lumConvTab[] = {
 	1320,  662,	  0};
 
 uint8_t valToPwm(int val) {
+	return valToPwm16(val) >> 8;
+}
+
+uint16_t valToPwm16(int val) {
 	if (val < 0)
 		val = 0;
 	if (val > 255)
 		val = 255;
-	return (65535 - lumConvTab[val]) >> 8;
+	return 65535 - lumConvTab[val];
 }
@@ -4,3 +4,6 @@
 
 // Converts an 0-255 intensity value to an equivalent  0-255 LED PWM value
 uint8_t valToPwm(int val);
+
+// Same as valToPwm() but with a 0-65535 result, for dithering
+uint16_t valToPwm16(int val);